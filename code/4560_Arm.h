@@ -0,0 +1,358 @@
+/**
+ * Arm controller for team 4560's robot. This moves the arm to an absolute
+ * encoder position along a trapezoidal motion profile, or at a velocity from
+ * the joystick, without blocking. It also keeps the arm and scoop presets the
+ * drivers teach during practice.
+ * All code written by Henrik Hodne unless otherwise noted. All code by Henrik
+ * Hodne is released under the MIT license (see the LICENSE file).
+ */
+
+
+#ifndef __4560_ARM_H__
+#define __4560_ARM_H__
+
+#include "4560_Control.h"
+#include "4560_Calibration.h"
+#include "4560_Encoders.h"
+#include "4560_Faults.h"
+#include "4560_Telemetry.h"
+#include "4560_Servo.h"
+#include "4560_Thermal.h"
+
+// How often (in ms) the arm controller updates.
+#define kArmPeriod 10
+
+// Top speed (encoder ticks/s) and acceleration (ticks/s/s) of arm moves. One
+// full rotation of the arm is around 3000 ticks.
+#define kArmMaxVelocity 1500
+#define kArmAcceleration 3000
+
+// Gains for following the profile (Q8). kArmKV turns the profile's velocity
+// into motor power, the PID takes care of the rest.
+#define kArmKP 64
+#define kArmKI 2
+#define kArmKD 32
+#define kArmKV 13
+
+// Where the arm is level (in encoder ticks from where it starts), how many
+// ticks it takes to go all the way around, and the power it takes to hold it
+// up when it's level. Holding it up takes less power the further it is from
+// level.
+#define kArmLevelPosition 750
+#define kArmTicksPerTurn 3000
+#define kArmGravity 15
+
+// Gains for following a velocity from the joystick (Q8).
+#define kArmVelocityKP 8
+#define kArmVelocityKI 1
+#define kArmVelocityKD 0
+
+// Top arm speed (ticks/s) from the joystick, and how far it has to be pushed
+// before the arm moves.
+#define kArmStickMaxVelocity 1500
+#define kArmStickDeadband 10
+
+// Whether to brake the arm actively when it's let go. If so, and it's still
+// moving, it gets reverse power in proportion to its speed (kArmBrakeKV, Q8)
+// until it's slower than kArmBrakeStopVelocity (ticks/s), for at most
+// kArmBrakeTime ms.
+bool bArmBrake = true;
+#define kArmBrakeKV 20
+#define kArmBrakeMaxPower 60
+#define kArmBrakeStopVelocity 30
+#define kArmBrakeTime 200
+
+// If the arm is pushed at least this hard (power) but moves slower than this
+// (ticks/s) for this long (ms), it's stuck (or its encoder is), so give up.
+#define kArmStallPower 50
+#define kArmStallVelocity 20
+#define kArmStallTime 300
+
+TProfile armProfile;
+TPid armPid;
+TPid armVelocityPid;
+bool bArmMoving = false;
+bool bArmVelocity = false;
+bool bArmBraking = false;
+long nArmBrakeStart = 0;
+long nArmBrakePosition = 0;
+long nArmLastStep = 0;
+long nArmStallTime = 0;
+
+/**
+ * Set the arm motor's power, turned down if the motor is getting hot (see
+ * 4560_Thermal.h). Nothing happens if we're in failure mode, and the check and
+ * the write can't be split up by another task.
+ *
+ * @param power The power to give the arm motor (positive is up).
+ */
+void setArmMotor(int power)
+{
+  if (faultActive(kFaultMotorWrite))
+    return;
+
+  power = thermalLimit(kEncArm, power);
+
+  hogCPU();
+#ifdef CONNECTION_DETECTION
+  if (!kInFailureMode)
+#endif
+  {
+    motor[motorArm] = power;
+    nThermalPower[kEncArm] = power;
+  }
+  releaseCPU();
+}
+
+/**
+ * Set up the arm controller. Should be called once before using the arm.
+ */
+void armControllerInit()
+{
+  profileInit(armProfile, kArmMaxVelocity, kArmAcceleration);
+  pidInit(armPid, kArmKP, kArmKI, kArmKD, -100, 100);
+  pidInit(armVelocityPid, kArmVelocityKP, kArmVelocityKI, kArmVelocityKD,
+          -100, 100);
+  bArmMoving = false;
+  bArmVelocity = false;
+  bArmBraking = false;
+}
+
+/**
+ * Work out how much power it takes to hold the arm still where it is.
+ *
+ * @param position The arm's encoder position.
+ * @return The power to hold it against gravity (positive is up).
+ */
+int armGravity(long position)
+{
+  int angle = (position - kArmLevelPosition) * 360 / kArmTicksPerTurn;
+  return ((long)kArmGravity * cosQ14(angle)) >> 14;
+}
+
+/**
+ * Start moving the arm to an absolute position. Call armControlStep() often to
+ * actually move it.
+ *
+ * @param position The encoder position to move to.
+ */
+void armMoveTo(long position)
+{
+  profileStart(armProfile, encoderPosition(kEncArm), position);
+  pidReset(armPid);
+  nArmLastStep = nSysTime;
+  nArmStallTime = 0;
+  bArmMoving = true;
+  bArmVelocity = false;
+  bArmBraking = false;
+}
+
+/**
+ * Stop following the profile, and leave the arm motor to the caller.
+ */
+void armCancel()
+{
+  bArmMoving = false;
+  bArmVelocity = false;
+  bArmBraking = false;
+}
+
+/**
+ * Let go of the arm. If bArmBrake is set and the arm is still moving, it's
+ * braked actively; call armBrakeStep() often until it's done.
+ */
+void armStop()
+{
+  armCancel();
+
+  if (bArmBrake && abs(encoderVelocity(kEncArm)) > kArmBrakeStopVelocity)
+  {
+    bArmBraking = true;
+    nArmBrakeStart = nSysTime;
+    nArmBrakePosition = encoderPosition(kEncArm);
+  }
+
+  setArmMotor(0);
+}
+
+/**
+ * Update the active braking started by armStop(). This doesn't block, and
+ * does nothing if the arm isn't braking. When the arm has stopped, how far it
+ * drifted after being let go is logged.
+ */
+void armBrakeStep()
+{
+  if (!bArmBraking)
+    return;
+
+  int velocity = encoderVelocity(kEncArm);
+  long position = encoderPosition(kEncArm);
+  long time = nSysTime - nArmBrakeStart;
+
+  if (abs(velocity) <= kArmBrakeStopVelocity || time > kArmBrakeTime)
+  {
+    bArmBraking = false;
+    setArmMotor(0);
+    telemetryEvent(kEventArmBrake, position - nArmBrakePosition, time);
+    return;
+  }
+
+  int power = -(((long)velocity * kArmBrakeKV) >> kQ) + armGravity(position);
+  setArmMotor(clampLong(power, -kArmBrakeMaxPower, kArmBrakeMaxPower));
+}
+
+/**
+ * Check whether the arm has finished its move.
+ *
+ * @return Whether the arm isn't following a profile any more.
+ */
+bool armIsDone()
+{
+  return !bArmMoving;
+}
+
+/**
+ * Update the arm controller. This doesn't block, so call it from the arm loop.
+ * It does nothing if the arm isn't moving, or if it ran less than kArmPeriod
+ * ms ago. If the arm stalls the move is given up.
+ */
+void armControlStep()
+{
+  if (!bArmMoving)
+    return;
+
+  long dt = nSysTime - nArmLastStep;
+  if (dt < kArmPeriod)
+    return;
+  nArmLastStep += dt;
+
+#ifdef CONNECTION_DETECTION
+  if (kInFailureMode)
+  {
+    bArmMoving = false;
+    return;
+  }
+#endif
+
+  bool bProfileDone = profileStep(armProfile, dt);
+  int setpoint = profilePosition(armProfile);
+  int position = encoderPosition(kEncArm);
+  int power = pidUpdate(armPid, setpoint, position) +
+              (((long)armProfile.velocity * kArmKV) >> kQ) +
+              armGravity(position);
+
+  if (bProfileDone && abs(setpoint - position) <= 10)
+  {
+    // Close enough, let go so the arm doesn't hunt around the target.
+    bArmMoving = false;
+    power = 0;
+  }
+
+  if (abs(power) < kArmStallPower ||
+      abs(encoderVelocity(kEncArm)) >= kArmStallVelocity)
+    nArmStallTime = 0;
+  else
+    nArmStallTime += dt;
+
+  if (nArmStallTime > kArmStallTime)
+  {
+    bArmMoving = false;
+    power = 0;
+    faultDetected(kFaultEncoderStuck);
+    telemetryEvent(kEventArmStall, position, setpoint);
+  }
+
+  setArmMotor(clampLong(power, -100, 100));
+}
+
+/**
+ * Turn a joystick value into an arm speed. The response curve is gentle near
+ * the middle for fine placement, and steep near the ends for fast moves.
+ *
+ * @param stick The joystick value (-128 to 127).
+ * @return The arm speed (ticks/s), 0 inside the dead band.
+ */
+int armStickVelocity(int stick)
+{
+  // Percent of top speed, every 8 steps of the joystick.
+  static const int nArmCurve[17] =
+  {
+    0,   2,   4,   6,   9,  12,  16,  20,
+    25,  31,  38,  46,  55,  65,  76,  88,
+    100
+  };
+
+  if (abs(stick) <= kArmStickDeadband)
+    return 0;
+
+  int percent = nArmCurve[min(abs(stick), 128) / 8];
+  return sgn(stick) * (long)percent * kArmStickMaxVelocity / 100;
+}
+
+/**
+ * Move the arm at a given speed, holding it up against gravity. This doesn't
+ * block, so call it from the arm loop for as long as the speed should be
+ * kept. It replaces any move started with armMoveTo(), and armCancel() stops
+ * it.
+ *
+ * @param velocity The speed to move at (ticks/s, positive is up).
+ */
+void armVelocityStep(int velocity)
+{
+  if (!bArmVelocity)
+  {
+    pidReset(armVelocityPid);
+    bArmMoving = false;
+    bArmBraking = false;
+    bArmVelocity = true;
+    nArmLastStep = nSysTime - kArmPeriod;
+  }
+
+  if (nSysTime - nArmLastStep < kArmPeriod)
+    return;
+  nArmLastStep = nSysTime;
+
+  long position = encoderPosition(kEncArm);
+  int power = pidUpdate(armVelocityPid, velocity, encoderVelocity(kEncArm)) +
+              (((long)velocity * kArmKV) >> kQ) +
+              armGravity(position);
+
+  setArmMotor(clampLong(power, -100, 100));
+}
+
+/**
+ * Remember where the arm and the scoop are right now in a preset, and save it
+ * to the calibration file.
+ *
+ * @param slot The preset to remember them in (0 to kArmPresetCount - 1).
+ */
+void armPresetTeach(int slot)
+{
+  nCalibration[kCalArmPresets + 2 * slot] = encoderPosition(kEncArm);
+  nCalibration[kCalArmPresets + 2 * slot + 1] = servoGet(kServoScoop);
+  calibrationSave();
+}
+
+/**
+ * Start moving the arm and the scoop to a preset. Presets that haven't been
+ * taught are ignored.
+ *
+ * @param slot The preset to move to (0 to kArmPresetCount - 1).
+ */
+void armPresetGo(int slot)
+{
+#ifdef CONNECTION_DETECTION
+  if (kInFailureMode)
+    return;
+#endif
+
+  int scoop = nCalibration[kCalArmPresets + 2 * slot + 1];
+
+  if (scoop < 0)
+    return;
+
+  armMoveTo(nCalibration[kCalArmPresets + 2 * slot]);
+  servoSet(kServoScoop, scoop);
+}
+
+#endif // __4560_ARM_H__
@@ -0,0 +1,219 @@
+/**
+ * Saved arm position for team 4560's robot. The arm encoder starts from 0
+ * every time the program starts, which is only right if the arm is where it
+ * starts out. This keeps where the arm is in a file on the NXT, so when the
+ * program is restarted (between autonomous and TeleOp, or after a crash) it
+ * can pick up from there.
+ * All code written by Henrik Hodne unless otherwise noted. All code by Henrik
+ * Hodne is released under the MIT license (see the LICENSE file).
+ */
+
+
+#ifndef __4560_ARM_POSITION_H__
+#define __4560_ARM_POSITION_H__
+
+#include "4560_Arm.h"
+#include "4560_Joystick.h"
+
+#define kArmPositionFile "4560arm.dat"
+
+// The file starts with these, like the calibration file.
+#define kArmPositionMagic 4560
+#define kArmPositionVersion 1
+
+// How often (in ms) to check whether the arm has moved.
+#define kArmPositionPeriod 250
+
+// The position is only saved once the arm has stood still (slower than
+// kArmPositionStill ticks/s) for kArmPositionSettle ms, has moved more than
+// kArmPositionSlack ticks since the last save, and at most every
+// kArmPositionInterval ms. That keeps it down to a few writes a match.
+#define kArmPositionStill 20
+#define kArmPositionSettle 500
+#define kArmPositionSlack 10
+#define kArmPositionInterval 2000
+
+// A saved position is only used if it was saved less than this many ms ago.
+// The stamp is nSysTime, which starts again from 0 every time the NXT is
+// turned on, so this can't tell whether the NXT was turned off in between (and
+// the arm maybe moved by hand). If the match is already running, the program
+// was restarted, not the NXT, so the position is used straight away. Before
+// the match it has to be confirmed on the NXT (see armPositionConfirm());
+// nobody pressing anything within kArmPositionConfirmTime ms, or the match
+// starting first, means the arm is where it starts out.
+#define kArmPositionMaxAge 600000
+#define kArmPositionConfirmTime 10000
+
+// How long (in ms) to wait for the first message from the FCS, so a restart
+// in the middle of a match can be told from starting up before it.
+#define kArmPositionLinkTime 250
+
+long nArmPositionSaved = 0;
+long nArmPositionSaves = 0;
+
+/**
+ * Save where the arm is. This writes to flash, so it's up to the caller not
+ * to do it too often.
+ *
+ * @param position The arm position (ticks).
+ * @return Whether the file was saved.
+ */
+bool armPositionSave(long position)
+{
+  TFileHandle hFile;
+  TFileIOResult nIoResult;
+  int nFileSize = 2 * 2 + 2 * 4;
+
+  Delete(kArmPositionFile, nIoResult);
+  OpenWrite(hFile, nIoResult, kArmPositionFile, nFileSize);
+  if (nIoResult != ioRsltSuccess)
+    return false;
+
+  WriteShort(hFile, nIoResult, kArmPositionMagic);
+  WriteShort(hFile, nIoResult, kArmPositionVersion);
+  WriteLong(hFile, nIoResult, position);
+  WriteLong(hFile, nIoResult, nSysTime);
+  bool bSaved = nIoResult == ioRsltSuccess;
+
+  Close(hFile, nIoResult);
+
+  if (bSaved)
+  {
+    nArmPositionSaved = position;
+    nArmPositionSaves++;
+  }
+  return bSaved;
+}
+
+/**
+ * Check with the drivers whether to use a saved arm position. The orange
+ * button says yes; any other button, or none within kArmPositionConfirmTime
+ * ms, says no. So does the match starting, so this never holds up the robot
+ * once it should be moving.
+ *
+ * @param position The saved arm position (ticks).
+ * @return Whether to use it.
+ */
+bool armPositionConfirm(long position)
+{
+  long start = nSysTime;
+  bool bUse = false;
+
+  // Don't let the joystick driver draw over the question.
+  bDisplayDiagnostics = false;
+  eraseDisplay();
+  nxtDisplayTextLine(1, "Arm saved at %d", position);
+  nxtDisplayTextLine(3, "Orange: use it");
+  nxtDisplayTextLine(4, "Other: arm home");
+
+  while (nNxtButtonPressed == -1 && !joystickMatchStarted() &&
+         nSysTime - start < kArmPositionConfirmTime)
+    wait1Msec(10);
+
+  if (nNxtButtonPressed != -1)
+  {
+    bUse = nNxtButtonPressed == kEnterButton;
+    while (nNxtButtonPressed != -1)
+      wait1Msec(10);
+  }
+
+  eraseDisplay();
+  bDisplayDiagnostics = true;
+  return bUse;
+}
+
+/**
+ * Pick up the arm position from the file, if it's fresh and either the match
+ * is already running or the drivers confirm it (see armPositionConfirm()).
+ * Call this right after resetting the arm encoder, and before
+ * encoderServiceStart().
+ *
+ * @return Whether the position was restored (if not, the arm is taken to be
+ *         where it starts out).
+ */
+bool armPositionRestore()
+{
+  TFileHandle hFile;
+  TFileIOResult nIoResult;
+  int nFileSize;
+  short value;
+  long position = 0;
+  long stamp = -1;
+
+  OpenRead(hFile, nIoResult, kArmPositionFile, nFileSize);
+  if (nIoResult != ioRsltSuccess)
+    return false;
+
+  ReadShort(hFile, nIoResult, value);
+  if (nIoResult == ioRsltSuccess && value == kArmPositionMagic)
+  {
+    ReadShort(hFile, nIoResult, value);
+    if (nIoResult == ioRsltSuccess && value == kArmPositionVersion)
+    {
+      ReadLong(hFile, nIoResult, position);
+      if (nIoResult == ioRsltSuccess)
+        ReadLong(hFile, nIoResult, stamp);
+      if (nIoResult != ioRsltSuccess)
+        stamp = -1;
+    }
+  }
+
+  Close(hFile, nIoResult);
+
+  if (stamp < 0 || stamp > nSysTime || nSysTime - stamp > kArmPositionMaxAge)
+    return false;
+
+  long start = nSysTime;
+  while (joystickMessageCount == 0 && nSysTime - start < kArmPositionLinkTime)
+    wait1Msec(10);
+
+  if (!joystickMatchStarted() && !armPositionConfirm(position))
+    return false;
+
+  encoderSetPosition(kEncArm, position);
+  nArmPositionSaved = position;
+  writeDebugStreamLine("arm restored at %d", position);
+  return true;
+}
+
+/**
+ * Save the arm position whenever it has come to rest somewhere new. It's also
+ * saved again now and then while it's standing still, so it doesn't get too
+ * old to use.
+ */
+task armPositionService()
+{
+  long stillSince = nSysTime;
+  long lastSave = 0;
+
+  while (true)
+  {
+    wait1Msec(kArmPositionPeriod);
+
+    if (abs(encoderVelocity(kEncArm)) > kArmPositionStill)
+    {
+      stillSince = nSysTime;
+      continue;
+    }
+
+    long position = encoderPosition(kEncArm);
+    if (nSysTime - stillSince >= kArmPositionSettle &&
+        nSysTime - lastSave >= kArmPositionInterval &&
+        (abs(position - nArmPositionSaved) > kArmPositionSlack ||
+         nSysTime - lastSave >= kArmPositionMaxAge / 2))
+    {
+      armPositionSave(position);
+      lastSave = nSysTime;
+    }
+  }
+}
+
+/**
+ * Start saving the arm position. The encoder service has to be running.
+ */
+void armPositionServiceStart()
+{
+  StartTask(armPositionService);
+}
+
+#endif // __4560_ARM_POSITION_H__
@@ -0,0 +1,403 @@
+#pragma config(Hubs,  S1, HTMotor,  HTMotor,  HTMotor,  HTServo)
+#pragma config(Sensor, S2,     sensorCompass,       sensorI2CHiTechnicCompass)
+#pragma config(Sensor, S3,     sensorSonar,         sensorSONAR)
+#pragma config(Motor,  mtr_S1_C1_1,     motorNW,       tmotorNormal, openLoop, encoder)
+#pragma config(Motor,  mtr_S1_C1_2,     motorSW,       tmotorNormal, openLoop, encoder)
+#pragma config(Motor,  mtr_S1_C2_1,     motorArm,      tmotorNormal, openLoop, encoder)
+#pragma config(Motor,  mtr_S1_C2_2,     motorG,        tmotorNormal, openLoop)
+#pragma config(Motor,  mtr_S1_C3_1,     motorNE,       tmotorNormal, openLoop, encoder)
+#pragma config(Motor,  mtr_S1_C3_2,     motorSE,       tmotorNormal, openLoop, encoder)
+#pragma config(Servo,  srvo_S1_C4_1,    servoCompass,         tServoStandard)
+#pragma config(Servo,  srvo_S1_C4_2,    servoScoop,           tServoStandard)
+#pragma config(Servo,  srvo_S1_C4_3,    servoSweeper,         tServoContinuousRotation)
+//*!!Code automatically generated by 'ROBOTC' configuration wizard               !!*//
+
+/**
+ * Autonomous program for team 4560's FTC robot. While waiting for the start
+ * signal, the NXT buttons pick the alliance, the start position and which
+ * routine to run. The routines are tables of steps compiled into the program,
+ * so once the match starts the robot just runs through them.
+ * All code written by Henrik Hodne unless otherwise noted. All code written by
+ * Henrik Hodne is released under the MIT license (see the LICENSE file).
+ */
+
+#include "JoystickDriver.c"
+#include "4560_Common.h"
+#include "4560_Joystick.h"
+#include "4560_Range.h"
+#include "4560_Energy.h"
+#include "4560_ArmPosition.h"
+
+// How long autonomous lasts (ms).
+#define kAutonomousTime 30000
+
+// The steps a routine is made of. Every step is four numbers: the step, and
+// up to three arguments for it. Distances are in cm, headings in degrees
+// relative to the heading the robot started at, and times in ms. Routines are
+// written for the red alliance; on the blue alliance everything sideways is
+// mirrored.
+#define kStepEnd 0      // Stop here
+#define kStepDrive 1    // dx, dy, top speed (see waitForDrive())
+#define kStepTurn 2     // Heading to turn to
+#define kStepWall 3     // Distance from the wall, timeout (see driveToWall())
+#define kStepArm 4      // Preset to move the arm and scoop to
+#define kStepArmWait 5  // Wait for the arm, timeout
+#define kStepSweeper 6  // 1 to turn the sweeper on, -1 to reverse, 0 to stop
+#define kStepScoop 7    // Scoop servo position
+#define kStepWait 8     // Time to wait
+#define kStepSize 4
+
+// Choices on the menu.
+#define kAllianceRed 0
+#define kAllianceBlue 1
+#define kAllianceCount 2
+#define kStartNear 0
+#define kStartFar 1
+#define kStartCount 2
+#define kVariantCount 3
+
+// The last choice of variant isn't a routine; it measures how the robot turns
+// (see turnCalibrate()). Only use it in the pits.
+#define kVariantTurnCalibrate kVariantCount
+
+// All the routines, one after the other. kRoutineStart has where each one
+// starts, by start position and variant (start * kVariantCount + variant).
+const int kRoutineSteps[] = {
+  // Near, park: get out of the way of our partner.
+  kStepDrive, 0, 60, 60,
+  kStepEnd, 0, 0, 0,
+
+  // Near, score: drive up to the goal and tip the scoop into it.
+  kStepArm, 2, 0, 0,
+  kStepDrive, 0, 40, 80,
+  kStepTurn, 45, 0, 0,
+  kStepWall, 15, 3000, 0,
+  kStepArmWait, 2000, 0, 0,
+  kStepScoop, scoopServoDown, 0, 0,
+  kStepWait, 750, 0, 0,
+  kStepScoop, scoopServoUp, 0, 0,
+  kStepDrive, 0, -20, 60,
+  kStepArm, 0, 0, 0,
+  kStepArmWait, 2000, 0, 0,
+  kStepEnd, 0, 0, 0,
+
+  // Near, score and sweep: score, then pick up what's in front of the goal.
+  kStepArm, 2, 0, 0,
+  kStepDrive, 0, 40, 80,
+  kStepTurn, 45, 0, 0,
+  kStepWall, 15, 3000, 0,
+  kStepArmWait, 2000, 0, 0,
+  kStepScoop, scoopServoDown, 0, 0,
+  kStepWait, 750, 0, 0,
+  kStepScoop, scoopServoUp, 0, 0,
+  kStepDrive, 0, -30, 60,
+  kStepArm, 0, 0, 0,
+  kStepSweeper, 1, 0, 0,
+  kStepDrive, 40, 0, 40,
+  kStepSweeper, 0, 0, 0,
+  kStepEnd, 0, 0, 0,
+
+  // Far, park.
+  kStepDrive, 0, 60, 60,
+  kStepDrive, -60, 0, 60,
+  kStepEnd, 0, 0, 0,
+
+  // Far, score.
+  kStepArm, 2, 0, 0,
+  kStepDrive, -60, 80, 80,
+  kStepTurn, -45, 0, 0,
+  kStepWall, 15, 3000, 0,
+  kStepArmWait, 2000, 0, 0,
+  kStepScoop, scoopServoDown, 0, 0,
+  kStepWait, 750, 0, 0,
+  kStepScoop, scoopServoUp, 0, 0,
+  kStepDrive, 0, -20, 60,
+  kStepArm, 0, 0, 0,
+  kStepArmWait, 2000, 0, 0,
+  kStepEnd, 0, 0, 0,
+
+  // Far, wait for our partner, then score.
+  kStepWait, 8000, 0, 0,
+  kStepArm, 2, 0, 0,
+  kStepDrive, -60, 80, 80,
+  kStepTurn, -45, 0, 0,
+  kStepWall, 15, 3000, 0,
+  kStepArmWait, 2000, 0, 0,
+  kStepScoop, scoopServoDown, 0, 0,
+  kStepWait, 750, 0, 0,
+  kStepScoop, scoopServoUp, 0, 0,
+  kStepArm, 0, 0, 0,
+  kStepArmWait, 2000, 0, 0,
+  kStepEnd, 0, 0, 0,
+};
+
+const int kRoutineStart[] = {0, 2, 14, 28, 31, 43};
+
+/**
+ * Get the name of a menu choice, to show on the screen.
+ *
+ * @param item Which line of the menu (0 is the alliance, 1 the start position
+ *             and 2 the variant).
+ * @param choice The choice on that line.
+ * @return The name.
+ */
+string menuChoiceName(int item, int choice)
+{
+  if (item == 0)
+  {
+    if (choice == kAllianceRed)
+      return "Red";
+    return "Blue";
+  }
+  else if (item == 1)
+  {
+    if (choice == kStartNear)
+      return "Near";
+    return "Far";
+  }
+
+  switch (choice)
+  {
+    case 0: return "Park";
+    case 1: return "Score";
+    case 2: return "Score+";
+    default: return "Turn cal";
+  }
+}
+
+// The menu gives up, and goes with what's on the screen, after kMenuTimeout
+// ms without a button press, or as soon as the FCS starts the match.
+#define kMenuTimeout 30000
+
+/**
+ * Wait for one of the NXT buttons to be pressed and let go.
+ *
+ * @return The button, or -1 if the menu timed out or the match started.
+ */
+int menuWaitForButton()
+{
+  long start = nSysTime;
+
+  while (nNxtButtonPressed == -1)
+  {
+    if (joystickMatchStarted() || nSysTime - start > kMenuTimeout)
+      return -1;
+    wait1Msec(10);
+  }
+
+  int button = nNxtButtonPressed;
+  while (nNxtButtonPressed != -1)
+    wait1Msec(10);
+
+  return button;
+}
+
+int nAlliance = kAllianceRed;
+int nStart = kStartNear;
+int nVariant = 0;
+
+// Where the chosen routine starts in kRoutineSteps, and 1 or -1 to mirror it
+// for the alliance. These are worked out before the match starts.
+int nRoutineStep = 0;
+int nRoutineMirror = 1;
+
+/**
+ * Let the drivers pick a routine with the NXT buttons. The left and right
+ * buttons change the choice on the selected line, and the orange button goes
+ * to the next line. After the last line, the routine is ready to go (unless
+ * it was the turn calibration, which is run straight away). If nobody picks
+ * in time, the choices on the screen are used, so the robot still gets to run
+ * a routine.
+ */
+void selectRoutine()
+{
+  int choices[3];
+  int counts[3] = {kAllianceCount, kStartCount, kVariantCount + 1};
+  int item = 0;
+
+  choices[0] = nAlliance;
+  choices[1] = nStart;
+  choices[2] = nVariant;
+
+  // Don't let the joystick driver draw over the menu.
+  bDisplayDiagnostics = false;
+  eraseDisplay();
+
+  while (item < 3)
+  {
+    for (int i = 0; i < 3; i++)
+    {
+      if (i == item)
+        nxtDisplayTextLine(i + 1, "> %s", menuChoiceName(i, choices[i]));
+      else
+        nxtDisplayTextLine(i + 1, "  %s", menuChoiceName(i, choices[i]));
+    }
+
+    int button = menuWaitForButton();
+    if (button == -1)
+      break;
+
+    if (button == kRightButton)
+      choices[item] = (choices[item] + 1) % counts[item];
+    else if (button == kLeftButton)
+      choices[item] = (choices[item] + counts[item] - 1) % counts[item];
+    else if (button == kEnterButton)
+      item++;
+
+    if (item == 3 && choices[2] == kVariantTurnCalibrate)
+    {
+      nxtDisplayTextLine(5, "Turning...");
+      if (turnCalibrate())
+        nxtDisplayTextLine(5, "%d %d %d", nCalibration[kCalTurnModel],
+                           nCalibration[kCalTurnModel + 1],
+                           nCalibration[kCalTurnModel + 2]);
+      else
+        nxtDisplayTextLine(5, "Turn cal failed");
+
+      choices[2] = 0;
+      item = 2;
+    }
+  }
+
+  // The turn calibration isn't a routine, so park instead if it's still on
+  // the screen.
+  if (choices[2] == kVariantTurnCalibrate)
+    choices[2] = 0;
+
+  nAlliance = choices[0];
+  nStart = choices[1];
+  nVariant = choices[2];
+  nRoutineStep = kRoutineStart[nStart * kVariantCount + nVariant] * kStepSize;
+  nRoutineMirror = nAlliance == kAllianceRed ? 1 : -1;
+
+  nxtDisplayTextLine(5, "Ready");
+  bDisplayDiagnostics = true;
+}
+
+/**
+ * Keep the arm controller running while the main task is busy with the drive.
+ */
+task autonomousArm()
+{
+  while (true)
+  {
+    armControlStep();
+    armBrakeStep();
+    wait1Msec(kArmPeriod / 2);
+  }
+}
+
+/**
+ * Run the chosen routine, step by step, until it ends.
+ */
+void runRoutine()
+{
+  int startHeading = getHeading();
+  int step = nRoutineStep;
+
+  while (kRoutineSteps[step] != kStepEnd)
+  {
+    int a = kRoutineSteps[step + 1];
+    int b = kRoutineSteps[step + 2];
+    int c = kRoutineSteps[step + 3];
+    long start = nSysTime;
+
+    switch (kRoutineSteps[step])
+    {
+      case kStepDrive:
+        waitForDrive(a * nRoutineMirror, b, c);
+        break;
+      case kStepTurn:
+        turnToHeading(startHeading + a * nRoutineMirror);
+        break;
+      case kStepWall:
+        driveToWall(a, b);
+        break;
+      case kStepArm:
+        armPresetGo(a);
+        break;
+      case kStepArmWait:
+        while (!armIsDone() && nSysTime - start < a)
+          wait1Msec(kArmPeriod);
+        break;
+      case kStepSweeper:
+        if (a > 0)
+          sweeperOn();
+        else if (a < 0)
+          sweeperReverse();
+        else
+          sweeperOff();
+        break;
+      case kStepScoop:
+        servoSet(kServoScoop, a);
+        break;
+      case kStepWait:
+        wait1Msec(a);
+        break;
+    }
+
+    step += kStepSize;
+  }
+
+  spin(0);
+}
+
+/**
+ * Set up the robot (initialize sensors, etc.), and let the drivers pick the
+ * routine.
+ *
+ * Nothing should move in this phase, and servos shouldn't be set to their
+ * initial position (use aboutToStart() for that).
+ */
+void initializeRobot()
+{
+  bFloatDuringInactiveMotorPWM = false;
+
+  servoInit();
+  compassSetup();
+  calibrationLoad();
+
+  // The arm starts out in the same place every time, and the presets are
+  // relative to that. If the program was restarted, the drivers can say the
+  // arm is where it was last saved instead.
+  nMotorEncoder[motorArm] = 0;
+  armPositionRestore();
+  encoderServiceStart();
+  thermalServiceStart();
+  armPositionServiceStart();
+  armControllerInit();
+
+  servoSet(kServoScoop, 150);
+  servoServiceStart();
+
+  selectRoutine();
+}
+
+/**
+ * Set up servos and other initializing things that make the robot move.
+ */
+void aboutToStart()
+{
+  compassUp();
+  servoSet(kServoScoop, scoopServoUp);
+  rangeServiceStart();
+  StartTask(autonomousArm);
+  energyServiceStart(kAutonomousTime);
+}
+
+/**
+ * The main task. This will initialize the robot and pick a routine, wait for
+ * the start signal from the FCS, run the routine, then idle until the program
+ * ends.
+ */
+task main()
+{
+  initializeRobot();
+  waitForStart();
+  aboutToStart();
+  runRoutine();
+
+  // So the program doesn't just exit.
+  while (true)
+    wait1Msec(5);
+}
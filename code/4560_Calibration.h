@@ -0,0 +1,159 @@
+/**
+ * Calibration file for team 4560's robot. Everything the drivers tune on the
+ * robot (arm presets, the input map and so on) is kept in nCalibration and
+ * saved to a file on the NXT, so it survives restarts without recompiling.
+ * All code written by Henrik Hodne unless otherwise noted. All code by Henrik
+ * Hodne is released under the MIT license (see the LICENSE file).
+ */
+
+
+#ifndef __4560_CALIBRATION_H__
+#define __4560_CALIBRATION_H__
+
+#include "4560_Input.h"
+
+#define kCalibrationFile "4560cal.dat"
+
+// The file starts with these, so we don't load something that isn't ours, or
+// that was written by an older version of this code. Bump the version every
+// time the layout below changes.
+#define kCalibrationMagic 4560
+#define kCalibrationVersion 3
+
+// Layout of nCalibration.
+// Arm presets, as pairs of (arm encoder position, scoop servo position). A
+// scoop position of -1 means the preset hasn't been taught yet.
+#define kArmPresetCount 3
+#define kCalArmPresets 0
+// The input map, as (controller, input, event, action) for each entry (see
+// 4560_Input.h). Unused entries are all 0.
+#define kInputMapSize 24
+#define kCalInputMap 6
+// How the robot spins (see turnCalibrate()): top speed (degrees/s), and how
+// fast it speeds up and slows down (degrees/s/s).
+#define kCalTurnModel 102
+#define kCalibrationSize 105
+
+int nCalibration[kCalibrationSize];
+
+/**
+ * Fill nCalibration with the values to use when there's no calibration file.
+ */
+void calibrationDefaults()
+{
+  for (int i = 0; i < kArmPresetCount; i++)
+  {
+    nCalibration[kCalArmPresets + 2 * i] = 0;
+    nCalibration[kCalArmPresets + 2 * i + 1] = -1;
+  }
+
+  for (int i = 0; i < kInputMapSize * 4; i++)
+  {
+    if (i < kDefaultInputMapSize * 4)
+      nCalibration[kCalInputMap + i] = kDefaultInputMap[i];
+    else
+      nCalibration[kCalInputMap + i] = 0;
+  }
+
+  nCalibration[kCalTurnModel] = 180;
+  nCalibration[kCalTurnModel + 1] = 600;
+  nCalibration[kCalTurnModel + 2] = 600;
+}
+
+/**
+ * Build the input map (see 4560_Input.h) from nCalibration.
+ */
+void calibrationApplyInputMap()
+{
+  inputMapClear();
+
+  for (int i = 0; i < kInputMapSize; i++)
+  {
+    int entry = kCalInputMap + 4 * i;
+    inputMapAdd(nCalibration[entry], nCalibration[entry + 1],
+                nCalibration[entry + 2], nCalibration[entry + 3]);
+  }
+}
+
+/**
+ * Load nCalibration from the calibration file, and build the input map from
+ * it. If the file is missing or doesn't look right, the defaults are used
+ * instead.
+ *
+ * @return Whether the file was loaded.
+ */
+bool calibrationLoad()
+{
+  TFileHandle hFile;
+  TFileIOResult nIoResult;
+  int nFileSize;
+  short value;
+  bool bLoaded = false;
+
+  calibrationDefaults();
+
+  OpenRead(hFile, nIoResult, kCalibrationFile, nFileSize);
+  if (nIoResult != ioRsltSuccess)
+  {
+    calibrationApplyInputMap();
+    return false;
+  }
+
+  ReadShort(hFile, nIoResult, value);
+  if (nIoResult == ioRsltSuccess && value == kCalibrationMagic)
+  {
+    ReadShort(hFile, nIoResult, value);
+    if (nIoResult == ioRsltSuccess && value == kCalibrationVersion)
+    {
+      bLoaded = true;
+      for (int i = 0; i < kCalibrationSize && bLoaded; i++)
+      {
+        ReadShort(hFile, nIoResult, value);
+        if (nIoResult == ioRsltSuccess)
+          nCalibration[i] = value;
+        else
+          bLoaded = false;
+      }
+    }
+  }
+
+  Close(hFile, nIoResult);
+
+  if (!bLoaded)
+    calibrationDefaults();
+  calibrationApplyInputMap();
+  return bLoaded;
+}
+
+/**
+ * Save nCalibration to the calibration file. This writes to flash, so don't
+ * call it from a loop.
+ *
+ * @return Whether the file was saved.
+ */
+bool calibrationSave()
+{
+  TFileHandle hFile;
+  TFileIOResult nIoResult;
+  int nFileSize = (kCalibrationSize + 2) * 2;
+  bool bSaved = true;
+
+  Delete(kCalibrationFile, nIoResult);
+  OpenWrite(hFile, nIoResult, kCalibrationFile, nFileSize);
+  if (nIoResult != ioRsltSuccess)
+    return false;
+
+  WriteShort(hFile, nIoResult, kCalibrationMagic);
+  WriteShort(hFile, nIoResult, kCalibrationVersion);
+  for (int i = 0; i < kCalibrationSize; i++)
+  {
+    WriteShort(hFile, nIoResult, nCalibration[i]);
+    if (nIoResult != ioRsltSuccess)
+      bSaved = false;
+  }
+
+  Close(hFile, nIoResult);
+  return bSaved;
+}
+
+#endif // __4560_CALIBRATION_H__
@@ -0,0 +1,147 @@
+/**
+ * Collision detection for team 4560's robot. This compares how the robot was
+ * told to move (the power the drive motors were given) with how it actually
+ * moves (the wheel encoders and the compass). When they disagree for a few
+ * updates in a row the robot has probably hit something, so it's logged, and
+ * the drive power can be backed off for a while.
+ * All code written by Henrik Hodne unless otherwise noted. All code by Henrik
+ * Hodne is released under the MIT license (see the LICENSE file).
+ */
+
+
+#ifndef __4560_COLLISION_H__
+#define __4560_COLLISION_H__
+
+#include "4560_Common.h"
+
+// How often (in ms) the detector runs.
+#define kCollisionPeriod 20
+
+// How fast the robot moves (odometry ticks/s) and turns (degrees/s) per
+// percent of power, once it's up to speed.
+#define kDriveVelocityPerPower 25
+#define kSpinRatePerPower 2
+
+// The robot doesn't get up to speed straight away, so the expected motion
+// follows the commanded motion with this lag (Q8, the part of the difference
+// made up each update).
+#define kCollisionLag 64
+
+// Translation only counts as blocked when the robot should be going at least
+// kCollisionMinSpeed (ticks/s) but gets less than kCollisionRatio percent of
+// that. Turning counts as wrong when the compass turns more than
+// kCollisionYawRate (degrees/s) off what's expected, which is only checked
+// while the heading is fresh.
+#define kCollisionMinSpeed 500
+#define kCollisionRatio 40
+#define kCollisionYawRate 60
+
+// How many updates in a row it has to look wrong for.
+#define kCollisionUpdates 3
+
+// Whether to back off after a collision, how much power (percent) to allow,
+// and for how long (ms).
+bool bCollisionBackoff = false;
+#define kCollisionBackoffPower 30
+#define kCollisionBackoffTime 500
+
+bool bCollision = false;
+long nCollisionCount = 0;
+
+/**
+ * Watch for collisions, and back off the drive after them.
+ */
+task collisionDetector()
+{
+  long expectedX = 0, expectedY = 0, expectedTurn = 0;
+  int suspicious = 0;
+  long backoffEnd = 0;
+
+  while (true)
+  {
+    wait1Msec(kCollisionPeriod);
+
+    hogCPU();
+    long pNE = nDrivePower[0];
+    long pNW = nDrivePower[1];
+    long pSW = nDrivePower[2];
+    long pSE = nDrivePower[3];
+    releaseCPU();
+
+    // What the mixer asked for, and where the robot should be by now.
+    long commandX = (-pNE - pNW + pSW + pSE) / 4 * kDriveVelocityPerPower;
+    long commandY = (pNE - pNW - pSW + pSE) / 4 * kDriveVelocityPerPower;
+    long commandTurn = -(pNE + pNW + pSW + pSE) / 4 * kSpinRatePerPower;
+    expectedX += ((commandX - expectedX) * kCollisionLag) >> 8;
+    expectedY += ((commandY - expectedY) * kCollisionLag) >> 8;
+    expectedTurn += ((commandTurn - expectedTurn) * kCollisionLag) >> 8;
+
+    // What the wheels and the compass say.
+    long vNE = encoderVelocity(kEncNE);
+    long vNW = encoderVelocity(kEncNW);
+    long vSW = encoderVelocity(kEncSW);
+    long vSE = encoderVelocity(kEncSE);
+    long measuredX = (-vNE - vNW + vSW + vSE) / 4;
+    long measuredY = (vNE - vNW - vSW + vSE) / 4;
+    long yawRate = nHeadingRate;
+
+#ifdef CONNECTION_DETECTION
+    if (kInFailureMode)
+    {
+      suspicious = 0;
+      continue;
+    }
+#endif
+
+    bool bBlocked = false;
+    long expectedSpeed2 = expectedX * expectedX + expectedY * expectedY;
+    if (expectedSpeed2 > (long)kCollisionMinSpeed * kCollisionMinSpeed)
+    {
+      // How much of the expected motion we actually got (percent).
+      long along = (measuredX * expectedX + measuredY * expectedY) /
+                   (expectedSpeed2 / 100);
+      bBlocked = along < kCollisionRatio;
+    }
+
+    // A compass that's out says nothing about how we're turning.
+    bool bKnocked = headingIsFresh(kHeadingStaleAge) &&
+                    abs(yawRate - expectedTurn) > kCollisionYawRate;
+
+    if (bBlocked || bKnocked)
+      suspicious++;
+    else
+    {
+      suspicious = 0;
+      bCollision = false;
+    }
+
+    if (suspicious == kCollisionUpdates)
+    {
+      bCollision = true;
+      nCollisionCount++;
+      telemetryEvent(kEventCollision, bBlocked, yawRate - expectedTurn);
+
+      if (bCollisionBackoff)
+      {
+        nDriveLimit = kCollisionBackoffPower;
+        backoffEnd = nSysTime + kCollisionBackoffTime;
+      }
+    }
+
+    if (backoffEnd != 0 && nSysTime > backoffEnd && !bCollision)
+    {
+      nDriveLimit = 100;
+      backoffEnd = 0;
+    }
+  }
+}
+
+/**
+ * Start the collision detector.
+ */
+void collisionDetectorStart()
+{
+  StartTask(collisionDetector);
+}
+
+#endif // __4560_COLLISION_H__
@@ -9,6 +9,12 @@
 #define __4560_COMMON_H__
 
 #include "HTMC-driver.h"
+#include "4560_Control.h"
+#include "4560_Faults.h"
+#include "4560_Heading.h"
+#include "4560_Encoders.h"
+#include "4560_Servo.h"
+#include "4560_Arm.h"
 
 // Positions for the double servo on the scoop
 #define scoopServoUp 156
@@ -39,16 +45,68 @@ float atan2(float xVal, float yVal)
     return 0; // Actually undefined
 }
 
+// The most power (in percent of what's asked for) the drive motors get. Things
+// like backing off after a collision turn this down for a while.
+int nDriveLimit = 100;
+
+// The most power (in percent) any drive motor gets. Unlike nDriveLimit, this
+// only turns down drives that would go over it, so slow moves aren't slowed
+// down more. The power budget (see 4560_Energy.h) turns this down.
+int nDrivePeak = 100;
+
+// The power the drive motors were last given, as NE, NW, SW, SE.
+int nDrivePower[4];
+
 void setMotors(int mNEvalue, int mNWvalue, int mSWvalue, int mSEvalue)
 {
-#ifdef CONNECTION_DETECTION
-  if (kInFailureMode)
+  if (faultActive(kFaultMotorWrite))
     return;
+
+  if (nDriveLimit < 100)
+  {
+    mNEvalue = (long)mNEvalue * nDriveLimit / 100;
+    mNWvalue = (long)mNWvalue * nDriveLimit / 100;
+    mSWvalue = (long)mSWvalue * nDriveLimit / 100;
+    mSEvalue = (long)mSEvalue * nDriveLimit / 100;
+  }
+
+  int peak = max(max(abs(mNEvalue), abs(mNWvalue)),
+                 max(abs(mSWvalue), abs(mSEvalue)));
+  if (peak > nDrivePeak)
+  {
+    // Scale them all down together, so the robot still goes the same way.
+    mNEvalue = (long)mNEvalue * nDrivePeak / peak;
+    mNWvalue = (long)mNWvalue * nDrivePeak / peak;
+    mSWvalue = (long)mSWvalue * nDrivePeak / peak;
+    mSEvalue = (long)mSEvalue * nDrivePeak / peak;
+  }
+
+  mNEvalue = thermalLimit(kEncNE, mNEvalue);
+  mNWvalue = thermalLimit(kEncNW, mNWvalue);
+  mSWvalue = thermalLimit(kEncSW, mSWvalue);
+  mSEvalue = thermalLimit(kEncSE, mSEvalue);
+
+  // Don't let another task enter failure mode between the check and the
+  // writes, or get in between the four writes.
+  hogCPU();
+#ifdef CONNECTION_DETECTION
+  if (!kInFailureMode)
 #endif
-  motor[motorNE] = mNEvalue;
-  motor[motorNW] = mNWvalue;
-  motor[motorSW] = mSWvalue;
-  motor[motorSE] = mSEvalue;
+  {
+    motor[motorNE] = mNEvalue;
+    motor[motorNW] = mNWvalue;
+    motor[motorSW] = mSWvalue;
+    motor[motorSE] = mSEvalue;
+    nDrivePower[0] = mNEvalue;
+    nDrivePower[1] = mNWvalue;
+    nDrivePower[2] = mSWvalue;
+    nDrivePower[3] = mSEvalue;
+    nThermalPower[kEncNE] = mNEvalue;
+    nThermalPower[kEncNW] = mNWvalue;
+    nThermalPower[kEncSW] = mSWvalue;
+    nThermalPower[kEncSE] = mSEvalue;
+  }
+  releaseCPU();
 }
 
 // True: Logarithmic scale. False: Linear scale.
@@ -117,11 +175,13 @@ int scaleJoystick(int &yOrig, int nMaxPower = kMaximumPowerLevel)
 }
 
 /**
- * This sets up the compass and compass holder. Should be called by all
- * programs using the compass.
+ * This sets up the compass and compass holder, and starts the heading service.
+ * Should be called by all programs using the compass.
  */
 void compassSetup()
 {
+  headingServiceStart();
+
   // This isn't implemented in ROBOTC yet, but when it is this will protect the
   // servo from trying to push the arm into a C-channel.
   //servoMinPos[servoCompass] = compassHolderUp;
@@ -133,7 +193,7 @@ void compassSetup()
  */
 void compassUp()
 {
-  servo[servoCompass] = compassHolderUp;
+  servoSet(kServoCompass, compassHolderUp);
 }
 
 /**
@@ -141,7 +201,7 @@ void compassUp()
  *//*
 void compassDown()
 {
-  servo[servoCompass] = compassHolderDown;
+  servoSet(kServoCompass, compassHolderDown);
 }
 */
 /**
@@ -163,6 +223,68 @@ int cap100(int value)
     return value;
 }
 
+// Below this battery level (mV) the motor controllers are close to browning
+// out.
+#define kLowBatteryLevel 11000
+
+/**
+ * Get the level of the external (12V) battery.
+ *
+ * @return The average battery level, in mV.
+ */
+int getBatteryLevel()
+{
+  if (faultActive(kFaultBrownout))
+    return kFaultBrownoutLevel;
+  return externalBatteryAvg;
+}
+
+/**
+ * Drive the robot with a translation and a rotation at the same time. If any
+ * wheel would need more than 100, all of them are scaled down so the robot
+ * still moves in the right direction.
+ *
+ * @param x The speed to move "East" at.
+ * @param y The speed to move "North" at.
+ * @param turn The speed to spin at (see spin()).
+ */
+void drive(int x, int y, int turn)
+{
+  int mNE = -x + y - turn;
+  int mNW = -x - y - turn;
+  int mSW = x - y - turn;
+  int mSE = x + y - turn;
+
+  int biggest = max(max(abs(mNE), abs(mNW)), max(abs(mSW), abs(mSE)));
+  if (biggest > 100)
+  {
+    mNE = (long)mNE * 100 / biggest;
+    mNW = (long)mNW * 100 / biggest;
+    mSW = (long)mSW * 100 / biggest;
+    mSE = (long)mSE * 100 / biggest;
+  }
+
+  setMotors(mNE, mNW, mSW, mSE);
+}
+
+/**
+ * Moves the robot in a direction (given in degrees) where 0 degrees is "East",
+ * while spinning at a given speed.
+ *
+ * @param speed The speed at which to move, or magnitude of vector.
+ * @param angle The heading at which to move, or angle of vector (in degrees).
+ * @param turn The speed at which to spin (see spin()).
+ */
+void moveAndSpin(int speed, int angle, int turn)
+{
+  // Use cap100() to limit the joysticks to a circle, and then the robot won't
+  // move faster when going at an angle (besides, the motors only go to 100).
+  int x_value = cosDegrees(angle) * cap100(speed);
+  int y_value = sinDegrees(angle) * cap100(speed);
+
+  drive(x_value, y_value, turn);
+}
+
 /**
  * Moves the robot in a direction (given in degrees) where 0 degrees is "East".
  *
@@ -173,16 +295,7 @@ int cap100(int value)
  */
 void moveRobot(int speed, int angle)
 {
-  // Use cap100() to limit the joysticks to a circle, and then the robot won't
-  // move faster when going at an angle (besides, the motors only go to 100).
-  float x_value = cosDegrees(angle) * cap100(speed);
-  float y_value = sinDegrees(angle) * cap100(speed);
-
-  setMotors(
-    -x_value + y_value, // NE
-    -x_value - y_value, // NW
-    x_value - y_value,  // SW
-    x_value + y_value); // SE
+  moveAndSpin(speed, angle, 0);
 }
 
 /**
@@ -197,40 +310,151 @@ void spin(int speed)
   setMotors(-speed, -speed, -speed, -speed);
 }
 
+// Gains for the heading controller (Q8, see 4560_Control.h).
+#define kHeadingKP 26
+#define kHeadingKI 0
+#define kHeadingKD 0
+
+// The least power that actually gets the robot spinning.
+#define kHeadingMinPower 12
+
+// How close (in degrees) to the target heading is close enough.
+#define kHeadingTolerance 1
+
+// Give up turning after this many ms.
+#define kTurnTimeout 5000
+
+TPid headingPid;
+int nHeadingPower = 0;
+long nHeadingLastCount = -1;
+
+/**
+ * Get the heading controller ready for a new target. Call this before starting
+ * to use headingControllerStep().
+ */
+void headingControllerReset()
+{
+  pidInit(headingPid, kHeadingKP, kHeadingKI, kHeadingKD,
+          -100 + kHeadingMinPower, 100 - kHeadingMinPower);
+  nHeadingPower = 0;
+  nHeadingLastCount = -1;
+}
+
+/**
+ * Work out how fast to spin to get to a heading. This doesn't block and
+ * doesn't move anything, so it can be called from any loop. The controller is
+ * only updated when there's a new compass reading.
+ *
+ * @param heading The heading we want to point at. 0˚ is N.
+ * @return The speed to spin at (see spin()), 0 if we're there.
+ */
+int headingControllerStep(int heading)
+{
+  if (nHeadingCount == nHeadingLastCount)
+    return nHeadingPower;
+  nHeadingLastCount = nHeadingCount;
+
+  int current = getHeading();
+  int error = headingError(heading, current);
+  int power = pidUpdateHeading(headingPid, heading, current);
+
+  if (abs(error) <= kHeadingTolerance)
+    nHeadingPower = 0;
+  else if (error > 0)
+    nHeadingPower = kHeadingMinPower + max(power, 0);
+  else
+    nHeadingPower = -kHeadingMinPower + min(power, 0);
+
+  return nHeadingPower;
+}
+
+// Turns are done flat out at kTurnMaxPower, braking at the last moment the
+// turn model (see turnCalibrate()) says the robot will still stop on the
+// heading. Once it has slowed to kTurnSettleRate (degrees/s), or for turns
+// shorter than kTurnFineAngle (degrees), the heading controller finishes it.
+#define kTurnMaxPower 100
+#define kTurnFineAngle 10
+#define kTurnSettleRate 30
+
+// How far behind (in ms) the compass is, so we brake that much earlier.
+#define kTurnLatency 30
+
+/**
+ * Work out how far (in degrees) the robot would still turn if it started
+ * braking now, using the turn model.
+ *
+ * @param rate How fast it's turning towards the target now (degrees/s).
+ * @return How far it would turn before it stopped.
+ */
+long turnStoppingAngle(long rate)
+{
+  // The calibration file could have anything in it, so don't trust it.
+  long topRate = max(nCalibration[kCalTurnModel], 1);
+  long acceleration = max(nCalibration[kCalTurnModel + 1], 1);
+  long deceleration = max(nCalibration[kCalTurnModel + 2], 1);
+
+  // The compass is a bit behind, and the robot keeps speeding up meanwhile.
+  rate = min(max(rate, 0) + acceleration * kTurnLatency / 1000, topRate);
+
+  return rate * rate / (2 * deceleration) + rate * kTurnLatency / 1000;
+}
+
 /**
  * Spin until we're heading towards a given heading.
  *
  * @param heading The heading at which to point when done turning. 0˚ is N.
- * @param speed The speed at which to spin (lower is more accurate).
- * @return Whether we successfully turned.
+ * @return Whether we successfully turned (false if we timed out, or the
+ *         compass stopped answering).
  */
 bool turnToHeading(const int heading)
 {
-  // To prevent us from getting stuck.
-  int numReadings, direction, leftToTurn, speed;
+  long startTime = nSysTime;
+  long lastCount;
+  int start = getHeading();
+  int error = headingError(heading, start);
+  bool bCoarse = abs(error) > kTurnFineAngle;
+  bool bBraking = false;
 
-  int lastAngle = HTMCreadHeading(sensorCompass);
-  wait1Msec(50);
+  headingControllerReset();
 
-  do
+  while (abs(error) > kHeadingTolerance || bBraking)
   {
-    leftToTurn = (heading - lastAngle) % 360;
-    if (leftToTurn > 180)
+    if (nSysTime - startTime > kTurnTimeout)
+    {
+      spin(0);
+      return false;
+    }
+
+    lastCount = nHeadingCount;
+    int rate = nHeadingRate * sgn(error);
+
+    if (bCoarse && abs(error) <= turnStoppingAngle(rate))
     {
-      direction = -1;
-      leftToTurn -= 180;
-    } else {
-      direction = 1;
+      bCoarse = false;
+      bBraking = true;
     }
+    if (bBraking && rate <= kTurnSettleRate)
+      bBraking = false;
 
-    speed = 12 + (leftToTurn/10.0);
+    if (bCoarse)
+      spin(sgn(error) * kTurnMaxPower);
+    else if (bBraking)
+      spin(0);
+    else
+      spin(headingControllerStep(heading));
 
-    spin(speed*direction);
-    wait10Msec(1); // To give it a chance to start moving.
+    if (!waitForNewHeading(lastCount, kHeadingStaleAge))
+    {
+      // The compass stopped answering, so we can't tell where we're going.
+      spin(0);
+      return false;
+    }
+    error = headingError(heading, getHeading());
+  }
 
-    lastAngle = HTMCreadHeading(sensorCompass);
-    wait1Msec(50);
-  } while (heading != lastAngle);
+  spin(0);
+  telemetryEvent(kEventTurnDone, headingError(getHeading(), start),
+                 nSysTime - startTime);
   return true;
 }
 
@@ -242,7 +466,254 @@ bool turnToHeading(const int heading)
  */
 bool turnDegrees(int angle)
 {
-  return turnToHeading(HTMCreadHeading(sensorCompass)-angle);
+  return turnToHeading(getHeading()-angle);
+}
+
+// How hard and for how long (ms) turnCalibrate() spins the robot up, and how
+// much of that (at the end) it's expected to be at top speed for.
+#define kTurnCalibratePower 100
+#define kTurnCalibrateTime 1500
+#define kTurnCalibrateCruise 500
+
+/**
+ * Measure how the robot spins, for turnToHeading(), and save it in the
+ * calibration file. The robot spins up from standstill at full power, then
+ * brakes until it stops, so it needs a clear spot on the floor.
+ *
+ * The top speed comes from the last part of the spin up, when it should be
+ * going flat out. The robot speeds up at a fixed rate until then, so the angle
+ * it falls behind by gives the acceleration, and the angle it takes to stop
+ * gives the deceleration.
+ *
+ * @return Whether the measurement made sense (and was saved). It's false if
+ *         the compass stopped answering, and the robot is stopped.
+ */
+bool turnCalibrate()
+{
+  long start = nSysTime;
+  long lastCount = nHeadingCount;
+  int last = getHeading();
+  long angle = 0;
+  long cruiseAngle = 0;
+  long brakeAngle = 0;
+
+  spin(kTurnCalibratePower);
+  while (nSysTime - start < kTurnCalibrateTime)
+  {
+    if (!waitForNewHeading(lastCount, kHeadingStaleAge))
+    {
+      spin(0);
+      return false;
+    }
+    lastCount = nHeadingCount;
+    int turned = headingError(getHeading(), last);
+    last = getHeading();
+
+    angle += turned;
+    if (nSysTime - start > kTurnCalibrateTime - kTurnCalibrateCruise)
+      cruiseAngle += turned;
+  }
+
+  spin(0);
+  long brakeStart = nSysTime;
+  while (nSysTime - brakeStart < kTurnCalibrateTime)
+  {
+    if (!waitForNewHeading(lastCount, kHeadingStaleAge))
+      return false;
+    lastCount = nHeadingCount;
+    int turned = headingError(getHeading(), last);
+    last = getHeading();
+
+    brakeAngle += turned;
+    if (abs(nHeadingRate) < kTurnSettleRate)
+      break;
+  }
+
+  long topRate = cruiseAngle * 1000 / kTurnCalibrateCruise;
+  long lag = topRate * kTurnCalibrateTime / 1000 - angle;
+  if (topRate <= 0 || lag <= 0 || brakeAngle <= 0)
+    return false;
+
+  // These round down, and turnStoppingAngle() divides by the deceleration.
+  long acceleration = clampLong(topRate * topRate / (2 * lag), 1, 32767);
+  long deceleration = clampLong(topRate * topRate / (2 * brakeAngle), 1,
+                                32767);
+
+  nCalibration[kCalTurnModel] = topRate;
+  nCalibration[kCalTurnModel + 1] = acceleration;
+  nCalibration[kCalTurnModel + 2] = deceleration;
+  telemetryEvent(kEventTurnModel, acceleration, deceleration);
+
+  return calibrationSave();
+}
+
+// Encoder ticks (as worked out by driveOdometry()) per cm the robot moves.
+// Each wheel is at 45˚ to the direction of travel, so this is the wheel's
+// ticks per cm divided by sqrt(2).
+#define kDriveTicksPerCm 32
+
+// Top speed of the robot at full power (ticks/s), and how fast to speed up
+// and slow down (ticks/s/s) in driveDistance().
+#define kDriveMaxVelocity 2500
+#define kDriveAcceleration 3000
+
+// How often (in ms) driveStep() updates.
+#define kDrivePeriod 20
+
+// Gains (Q8) for staying on the profile along the path, for staying on the
+// path sideways, and for holding the heading.
+#define kDriveKP 40
+#define kDriveKI 1
+#define kDriveKD 0
+#define kDriveCrossKP 40
+#define kDriveHeadingKP 512
+
+// How close (in ticks) to the end is close enough, and how long (in ms) to
+// try before giving up.
+#define kDriveTolerance 20
+#define kDriveTimeout 10000
+
+/**
+ * Work out how far the robot has moved from the wheel encoders, using the
+ * same layout as drive().
+ *
+ * @param x Set to the distance moved "East" (ticks).
+ * @param y Set to the distance moved "North" (ticks).
+ * @param turn Set to the distance spun (ticks, same direction as spin()).
+ */
+void driveOdometry(long &x, long &y, long &turn)
+{
+  long dNE = encoderPosition(kEncNE);
+  long dNW = encoderPosition(kEncNW);
+  long dSW = encoderPosition(kEncSW);
+  long dSE = encoderPosition(kEncSE);
+
+  x = (-dNE - dNW + dSW + dSE) / 4;
+  y = (dNE - dNW - dSW + dSE) / 4;
+  turn = -(dNE + dNW + dSW + dSE) / 4;
+}
+
+TProfile driveProfile;
+TPid drivePid;
+TPid driveHeadingPid;
+bool bDriveDone = true;
+long nDriveStartX, nDriveStartY;
+long nDriveStartTime, nDriveLastStep;
+int nDriveUx, nDriveUy;     // Direction of travel (Q14)
+int nDriveHeading;
+
+/**
+ * Start driving a given distance, holding the current heading, without
+ * blocking. Call driveStep() often until bDriveDone is set.
+ *
+ * @param dx How far to go "East" (cm).
+ * @param dy How far to go "North" (cm).
+ * @param maxSpeed The top speed, as a motor power (0 to 100).
+ */
+void driveDistance(int dx, int dy, int maxSpeed)
+{
+  long turn;
+  long length = sqrt((float)dx * dx + (float)dy * dy) * kDriveTicksPerCm;
+
+  driveOdometry(nDriveStartX, nDriveStartY, turn);
+  nDriveHeading = getHeading();
+
+  if (length == 0)
+  {
+    bDriveDone = true;
+    return;
+  }
+
+  nDriveUx = (long)dx * kDriveTicksPerCm * 16384 / length;
+  nDriveUy = (long)dy * kDriveTicksPerCm * 16384 / length;
+
+  profileInit(driveProfile, (long)kDriveMaxVelocity * cap100(maxSpeed) / 100,
+              kDriveAcceleration);
+  profileStart(driveProfile, 0, length);
+  pidInit(drivePid, kDriveKP, kDriveKI, kDriveKD, -100, 100);
+  pidInit(driveHeadingPid, kDriveHeadingKP, 0, 0, -50, 50);
+
+  nDriveStartTime = nSysTime;
+  nDriveLastStep = nSysTime;
+  bDriveDone = false;
+}
+
+/**
+ * Start driving sideways a given distance (see driveDistance()).
+ *
+ * @param distance How far to go, positive is "East" (cm).
+ * @param maxSpeed The top speed, as a motor power (0 to 100).
+ */
+void strafeDistance(int distance, int maxSpeed)
+{
+  driveDistance(distance, 0, maxSpeed);
+}
+
+/**
+ * Update a move started with driveDistance(). This doesn't block, and does
+ * nothing if there's no move or if it ran less than kDrivePeriod ms ago. When
+ * the move is done the robot is stopped, bDriveDone is set, and how far off
+ * the end it stopped is logged.
+ */
+void driveStep()
+{
+  if (bDriveDone)
+    return;
+
+  long dt = nSysTime - nDriveLastStep;
+  if (dt < kDrivePeriod)
+    return;
+  nDriveLastStep += dt;
+
+  long x, y, turn;
+  driveOdometry(x, y, turn);
+  x -= nDriveStartX;
+  y -= nDriveStartY;
+
+  // How far we've got along the path, and how far off to the side we are.
+  long along = (x * nDriveUx + y * nDriveUy) >> 14;
+  long cross = (y * nDriveUx - x * nDriveUy) >> 14;
+
+  bool bProfileDone = profileStep(driveProfile, dt);
+  long setpoint = profilePosition(driveProfile);
+  long error = setpoint - along;
+
+  if ((bProfileDone && abs(error) <= kDriveTolerance) ||
+      nSysTime - nDriveStartTime > kDriveTimeout)
+  {
+    spin(0);
+    bDriveDone = true;
+    telemetryEvent(kEventDriveDone, driveProfile.target - along,
+                   nSysTime - nDriveStartTime);
+    return;
+  }
+
+  int speed = pidUpdateError(drivePid, clampLong(error, -32000, 32000), 0) +
+              (long)driveProfile.velocity * 100 / kDriveMaxVelocity;
+  int correction = -((cross * kDriveCrossKP) >> kQ);
+  int turnSpeed = pidUpdateHeading(driveHeadingPid, nDriveHeading,
+                                   getHeading());
+
+  drive(((long)speed * nDriveUx - (long)correction * nDriveUy) >> 14,
+        ((long)speed * nDriveUy + (long)correction * nDriveUx) >> 14,
+        turnSpeed);
+}
+
+/**
+ * Drive a given distance and wait until it's done (see driveDistance()).
+ *
+ * @param dx How far to go "East" (cm).
+ * @param dy How far to go "North" (cm).
+ * @param maxSpeed The top speed, as a motor power (0 to 100).
+ */
+void waitForDrive(int dx, int dy, int maxSpeed)
+{
+  driveDistance(dx, dy, maxSpeed);
+  while (!bDriveDone)
+  {
+    driveStep();
+    wait1Msec(kDrivePeriod / 2);
+  }
 }
 
 /**
@@ -250,11 +721,12 @@ bool turnDegrees(int angle)
  */
 void sweeperOn()
 {
+  hogCPU();
 #ifdef CONNECTION_DETECTION
-  if (kInFailureMode)
-    return;
+  if (!kInFailureMode)
 #endif
-  servo[servoSweeper] = 0;
+    servoSet(kServoSweeper, 0);
+  releaseCPU();
 }
 
 /**
@@ -264,7 +736,7 @@ void sweeperOff()
 {
   // We're not doing connection detection, since this is perfectly safe to do,
   // even if we lost connection (we're stopping things, not starting things).
-  servo[servoSweeper] = 128;
+  servoSet(kServoSweeper, 128);
 }
 
 /**
@@ -272,15 +744,16 @@ void sweeperOff()
  */
 void sweeperReverse()
 {
+  hogCPU();
 #ifdef CONNECTION_DETECTION
-  if (kInFailureMode)
-    return;
+  if (!kInFailureMode)
 #endif
-  servo[servoSweeper] = 255;
+    servoSet(kServoSweeper, 255);
+  releaseCPU();
 }
 
 /**
- * Move the arm one step with a given speed.
+ * Move the arm one step with a given speed, then let go of it.
  *
  * @param speed The speed at which to move (positive is up, negative down).
  * @param stepSize How far to move (one full rotation of the arm is around 3000 steps).
@@ -295,19 +768,22 @@ void armStep(int speed, int stepSize)
   // Find out the direction to move.
   int direction = speed > 0 ? 1 : -1;
 
-  // Reset the motor encoder
-  nMotorEncoder[motorArm] = 0;
-  wait10Msec(1);
+  // Steps are relative to where the arm is, but we don't reset the encoder
+  // since the arm presets need absolute positions.
+  armCancel();
+  long start = encoderPosition(kEncArm);
 
-  motor[motorArm] = speed;
+  setArmMotor(speed);
 
   if (direction == 1) {
-    while (nMotorEncoder[motorArm] < abs(stepSize))
-      wait1Msec(5);
+    while (encoderPosition(kEncArm) - start < abs(stepSize))
+      wait1Msec(kEncoderPeriod);
   } else {
-    while (nMotorEncoder[motorArm] > -abs(stepSize))
-      wait1Msec(5);
+    while (encoderPosition(kEncArm) - start > -abs(stepSize))
+      wait1Msec(kEncoderPeriod);
   }
+
+  armStop();
 }
 
 /**
@@ -0,0 +1,304 @@
+/**
+ * Fixed-point control library for team 4560's robot. The NXT has no FPU, so
+ * everything here is done with integers. Gains are in Q8 format, which means
+ * that 256 is 1.0, 128 is 0.5 and so on.
+ * All code written by Henrik Hodne unless otherwise noted. All code by Henrik
+ * Hodne is released under the MIT license (see the LICENSE file).
+ */
+
+
+#ifndef __4560_CONTROL_H__
+#define __4560_CONTROL_H__
+
+// Number of fractional bits in gains.
+#define kQ 8
+
+/**
+ * Limit a number to be between a lower and an upper bound (inclusive).
+ *
+ * @param value The number to limit.
+ * @param lower The lowest value to return.
+ * @param upper The highest value to return.
+ * @return value, limited to [lower, upper].
+ */
+long clampLong(long value, long lower, long upper)
+{
+  if (value > upper)
+    return upper;
+  else if (value < lower)
+    return lower;
+  else
+    return value;
+}
+
+/**
+ * Sine of an angle, without floating point math. Uses a table every 5 degrees
+ * and interpolates in between, which is good to about 0.1%.
+ *
+ * @param degrees The angle, in degrees (any value).
+ * @return The sine of the angle, in Q14 (16384 is 1.0).
+ */
+int sinQ14(int degrees)
+{
+  static const int nSinTable[19] =
+  {
+        0,  1428,  2845,  4240,  5604,  6924,  8192,  9397, 10531, 11585,
+    12551, 13421, 14189, 14849, 15396, 15826, 16135, 16322, 16384
+  };
+
+  int angle = degrees % 360;
+  if (angle < 0)
+    angle += 360;
+
+  int sign = 1;
+  if (angle >= 180)
+  {
+    angle -= 180;
+    sign = -1;
+  }
+  if (angle > 90)
+    angle = 180 - angle;
+
+  int i = angle / 5;
+  int value = nSinTable[i];
+  if (i < 18)
+    value += (nSinTable[i + 1] - nSinTable[i]) * (angle % 5) / 5;
+
+  return sign * value;
+}
+
+/**
+ * Cosine of an angle, without floating point math (see sinQ14()).
+ *
+ * @param degrees The angle, in degrees (any value).
+ * @return The cosine of the angle, in Q14 (16384 is 1.0).
+ */
+int cosQ14(int degrees)
+{
+  return sinQ14(degrees + 90);
+}
+
+/**
+ * Find the shortest way from one heading to another.
+ *
+ * @param target The heading we want to be at.
+ * @param current The heading we're at.
+ * @return The number of degrees to turn, between -180 and 179.
+ */
+int headingError(int target, int current)
+{
+  int error = (target - current) % 360;
+
+  if (error >= 180)
+    error -= 360;
+  else if (error < -180)
+    error += 360;
+
+  return error;
+}
+
+/**
+ * State of a PID controller. Set it up with pidInit() and don't touch the
+ * fields directly.
+ *
+ * The controller assumes that it's updated at a fixed rate, so the I and D
+ * gains are per update, not per second. The derivative is taken on the
+ * measurement instead of the error, so changing the setpoint doesn't kick the
+ * output.
+ */
+typedef struct
+{
+  long kP, kI, kD;      // Gains (Q8)
+  long integral;        // Sum of kI * error (Q8, in output units)
+  long integralMax;     // Limit for the integral (Q8, in output units)
+  int lastMeasurement;
+  bool bHasMeasurement;
+  int outMin, outMax;
+} TPid;
+
+/**
+ * Forget the integral and the last measurement of a PID controller.
+ *
+ * @param pid The controller to reset.
+ */
+void pidReset(TPid &pid)
+{
+  pid.integral = 0;
+  pid.lastMeasurement = 0;
+  pid.bHasMeasurement = false;
+}
+
+/**
+ * Set up a PID controller.
+ *
+ * @param pid The controller to set up.
+ * @param kP Proportional gain (Q8).
+ * @param kI Integral gain (Q8).
+ * @param kD Derivative gain (Q8).
+ * @param outMin The lowest output.
+ * @param outMax The highest output. The integral is limited to this as well.
+ */
+void pidInit(TPid &pid, long kP, long kI, long kD, int outMin, int outMax)
+{
+  pid.kP = kP;
+  pid.kI = kI;
+  pid.kD = kD;
+  pid.outMin = outMin;
+  pid.outMax = outMax;
+  pid.integralMax = (long)max(abs(outMin), abs(outMax)) << kQ;
+  pidReset(pid);
+}
+
+/**
+ * Run one update of a PID controller, when the caller has already worked out
+ * the error and how much the measurement changed (useful for things that wrap
+ * around, like headings).
+ *
+ * @param pid The controller to update.
+ * @param error How far the measurement is from the setpoint.
+ * @param measurementChange How much the measurement changed since last update.
+ * @return The new output, between outMin and outMax.
+ */
+int pidUpdateError(TPid &pid, int error, int measurementChange)
+{
+  pid.integral = clampLong(pid.integral + pid.kI * error,
+                           -pid.integralMax, pid.integralMax);
+
+  long output = pid.kP * error + pid.integral;
+  if (pid.bHasMeasurement)
+    output -= pid.kD * measurementChange;
+
+  pid.bHasMeasurement = true;
+
+  return clampLong(output >> kQ, pid.outMin, pid.outMax);
+}
+
+/**
+ * Run one update of a PID controller.
+ *
+ * @param pid The controller to update.
+ * @param setpoint Where we want to be.
+ * @param measurement Where we are.
+ * @return The new output, between outMin and outMax.
+ */
+int pidUpdate(TPid &pid, int setpoint, int measurement)
+{
+  int change = measurement - pid.lastMeasurement;
+  pid.lastMeasurement = measurement;
+  return pidUpdateError(pid, setpoint - measurement, change);
+}
+
+/**
+ * Run one update of a PID controller that holds a heading. This takes care of
+ * the wrap-around between 359˚ and 0˚.
+ *
+ * @param pid The controller to update.
+ * @param target The heading we want to be at.
+ * @param heading The heading we're at.
+ * @return The new output, between outMin and outMax.
+ */
+int pidUpdateHeading(TPid &pid, int target, int heading)
+{
+  int change = headingError(heading, pid.lastMeasurement);
+  pid.lastMeasurement = heading;
+  return pidUpdateError(pid, headingError(target, heading), change);
+}
+
+/**
+ * State of a trapezoidal motion profile: it speeds up at a fixed rate, cruises
+ * at a top speed, and slows down at the same rate so it stops on the target.
+ * Positions are kept in thousandths of a unit, so slow profiles still move.
+ */
+typedef struct
+{
+  long position;     // Where the profile is now (1/1000 units)
+  long target;       // Where it's going (units)
+  int velocity;      // Units per second
+  int maxVelocity;   // Units per second
+  int acceleration;  // Units per second per second
+  bool bDone;
+} TProfile;
+
+/**
+ * Set up a motion profile. It starts out done, at position 0.
+ *
+ * @param profile The profile to set up.
+ * @param maxVelocity The top speed, in units per second.
+ * @param acceleration How fast to speed up and slow down (units/s/s).
+ */
+void profileInit(TProfile &profile, int maxVelocity, int acceleration)
+{
+  profile.maxVelocity = maxVelocity;
+  profile.acceleration = acceleration;
+  profile.position = 0;
+  profile.target = 0;
+  profile.velocity = 0;
+  profile.bDone = true;
+}
+
+/**
+ * Start a motion profile from standstill.
+ *
+ * @param profile The profile to start.
+ * @param from Where to start (units).
+ * @param to Where to stop (units).
+ */
+void profileStart(TProfile &profile, long from, long to)
+{
+  profile.position = from * 1000;
+  profile.target = to;
+  profile.velocity = 0;
+  profile.bDone = (from == to);
+}
+
+/**
+ * Get where a motion profile is right now.
+ *
+ * @param profile The profile.
+ * @return The current position (units).
+ */
+long profilePosition(TProfile &profile)
+{
+  return profile.position / 1000;
+}
+
+/**
+ * Move a motion profile forward in time.
+ *
+ * @param profile The profile to move.
+ * @param dt The number of ms since the last step.
+ * @return Whether the profile has reached its target.
+ */
+bool profileStep(TProfile &profile, int dt)
+{
+  if (profile.bDone)
+    return true;
+
+  long remaining = profile.target * 1000 - profile.position;
+  int direction = remaining >= 0 ? 1 : -1;
+  int dv = max((long)profile.acceleration * dt / 1000, 1);
+  long stopping = (long)profile.velocity * profile.velocity /
+                  (2 * profile.acceleration) * 1000;
+
+  if (profile.velocity * direction < 0 || abs(remaining) <= stopping)
+    // Going the wrong way, or it's time to slow down.
+    profile.velocity -= sgn(profile.velocity) * min(dv, abs(profile.velocity));
+  else
+    profile.velocity = clampLong(profile.velocity + direction * dv,
+                                 -profile.maxVelocity, profile.maxVelocity);
+
+  profile.position += (long)profile.velocity * dt;
+
+  long left = profile.target * 1000 - profile.position;
+  if (left == 0 || (left > 0) != (remaining > 0) ||
+      (profile.velocity == 0 && abs(left) < 1000))
+  {
+    profile.position = profile.target * 1000;
+    profile.velocity = 0;
+    profile.bDone = true;
+  }
+
+  return profile.bDone;
+}
+
+#endif // __4560_CONTROL_H__
@@ -0,0 +1,102 @@
+/**
+ * Scripted driver for team 4560's robot. Define SCRIPTED_DRIVER before
+ * including 4560_Joystick.h to have the robot driven by a script instead of
+ * the controllers, so changes to the drive, the arm presets and so on can be
+ * tried out on the practice field the same way every time. The script goes
+ * through the same joystick snapshots as a human driver, so everything after
+ * that runs just like in a match. Without SCRIPTED_DRIVER all of this compiles
+ * to nothing.
+ * All code written by Henrik Hodne unless otherwise noted. All code by Henrik
+ * Hodne is released under the MIT license (see the LICENSE file).
+ */
+
+
+#ifndef __4560_DRIVER_H__
+#define __4560_DRIVER_H__
+
+#include "4560_Joystick.h"
+
+#ifdef SCRIPTED_DRIVER
+
+// How often (in ms) a new message is sent, like the FCS does.
+#define kScriptMessagePeriod 50
+
+// The script: how long (ms) to hold each set of inputs, the left joystick
+// (x, y) and right joystick x on controller 1, the buttons on controllers 1
+// and 2 (button n is bit n - 1), and the TopHat on controller 2. It's one
+// pickup and score cycle, and it's run over and over. Button presses are only
+// held for one step, so they're seen as a press and a release.
+#define kScriptColumns 7
+#define kScriptSize 14
+const int kScript[kScriptSize * kScriptColumns] = {
+  // Start the sweeper and drive out to pick up.
+  100,  0,   0,   0, 0, 0x0002, TopHat_Idle,
+  1500, 0,   80,  0, 0, 0,      TopHat_Idle,
+  500,  0,   0,   0, 0, 0,      TopHat_Idle,
+  // Stop the sweeper, drive back and put the arm up on the way (preset 3).
+  100,  0,   0,   0, 0, 0x0004, TopHat_Idle,
+  100,  0,   -80, 0, 0, 0x0800, TopHat_Idle,
+  1400, 0,   -80, 0, 0, 0,      TopHat_Idle,
+  // Line up with the goal (button 5 on controller 1), and wait for the arm.
+  1500, 0,   0,   0, 0x0010, 0, TopHat_Idle,
+  // Tip the scoop, and tip it back.
+  1000, 0,   0,   0, 0, 0x0200, TopHat_Idle,
+  1000, 0,   0,   0, 0, 0x0100, TopHat_Idle,
+  // Put the arm down (preset 1), and wait for it.
+  100,  0,   0,   0, 0, 0x0040, TopHat_Idle,
+  1500, 0,   0,   0, 0, 0,      TopHat_Idle,
+  // Turn around a bit, and back again, like going round another robot.
+  500,  0,   0,   60,  0, 0,    TopHat_Idle,
+  500,  0,   0,   -60, 0, 0,    TopHat_Idle,
+  200,  0,   0,   0,   0, 0,    TopHat_Idle,
+};
+
+/**
+ * Send the script as joystick messages, over and over.
+ */
+task scriptedDriver()
+{
+  int step = 0;
+  long stepStart = nSysTime;
+
+  while (true)
+  {
+    int row = step * kScriptColumns;
+
+    hogCPU();
+    scriptJoystick.joy1_x1 = kScript[row + 1];
+    scriptJoystick.joy1_y1 = kScript[row + 2];
+    scriptJoystick.joy1_x2 = kScript[row + 3];
+    scriptJoystick.joy1_TopHat = TopHat_Idle;
+    scriptJoystick.joy1_Buttons = kScript[row + 4];
+    scriptJoystick.joy2_y1 = 0;
+    scriptJoystick.joy2_Buttons = kScript[row + 5];
+    scriptJoystick.joy2_TopHat = kScript[row + 6];
+    nScriptMessageCount++;
+    releaseCPU();
+
+    wait1Msec(kScriptMessagePeriod);
+
+    if (nSysTime - stepStart >= kScript[row])
+    {
+      step = (step + 1) % kScriptSize;
+      stepStart = nSysTime;
+    }
+  }
+}
+
+/**
+ * Start the scripted driver.
+ */
+void scriptedDriverStart()
+{
+  StartTask(scriptedDriver);
+}
+
+#else
+
+#define scriptedDriverStart()
+
+#endif // SCRIPTED_DRIVER
+
+#endif // __4560_DRIVER_H__
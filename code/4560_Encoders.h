@@ -0,0 +1,194 @@
+/**
+ * Encoder service for team 4560's robot. This reads all the motor encoders in
+ * one go at a fixed rate, keeps a short history of them, and works out how
+ * fast each one is turning. Everything else should use encoderPosition() and
+ * encoderVelocity() instead of reading nMotorEncoder.
+ * All code written by Henrik Hodne unless otherwise noted. All code by Henrik
+ * Hodne is released under the MIT license (see the LICENSE file).
+ */
+
+
+#ifndef __4560_ENCODERS_H__
+#define __4560_ENCODERS_H__
+
+#include "4560_Faults.h"
+
+// How often (in ms) the encoders are read.
+#define kEncoderPeriod 10
+
+// How many readings to keep for each encoder. The velocity is worked out over
+// all of them, so more means smoother but slower to react. Must be a power of
+// two.
+#define kEncoderHistory 8
+
+// No motor turns further than this (in ticks) between two reads, so a bigger
+// jump is a bad reading. If it happens kEncoderMaxRejects times in a row it's
+// probably real (like somebody resetting the encoder).
+#define kEncoderMaxJump 200
+#define kEncoderMaxRejects 3
+
+// The motors with encoders. Keep motors on the same controller next to each
+// other, so their reads happen back to back.
+#define kEncoderCount 5
+#define kEncNW 0
+#define kEncSW 1
+#define kEncArm 2
+#define kEncNE 3
+#define kEncSE 4
+tMotor nEncoderMotors[kEncoderCount] = {motorNW, motorSW,  // Controller 1
+                                        motorArm,          // Controller 2
+                                        motorNE, motorSE}; // Controller 3
+
+// Latest readings (ticks), and filtered velocities (ticks/s).
+long nEncoderPosition[kEncoderCount];
+int nEncoderVelocity[kEncoderCount];
+
+// History of readings, and when each batch was read.
+long nEncoderHistory[kEncoderCount][kEncoderHistory];
+long nEncoderHistoryTime[kEncoderHistory];
+int nEncoderHead = 0;
+long nEncoderCountRead = 0;
+int nEncoderRejects[kEncoderCount];
+
+// Added to the raw readings, so an encoder that was reset can carry on from
+// where it was (see encoderSetPosition()).
+long nEncoderOffset[kEncoderCount];
+
+/**
+ * Read one batch of encoders and update positions and velocities.
+ */
+void encoderServiceTick()
+{
+  long readings[kEncoderCount];
+
+  // Read them all at the same time, so they line up with each other.
+  hogCPU();
+  long now = nSysTime;
+  for (int i = 0; i < kEncoderCount; i++)
+    readings[i] = nMotorEncoder[nEncoderMotors[i]] + nEncoderOffset[i];
+  releaseCPU();
+
+  for (int i = 0; i < kEncoderCount; i++)
+  {
+    if (faultActive(kFaultEncoderStuck))
+      readings[i] = nEncoderPosition[i];
+    else if (faultActive(kFaultEncoderGlitch))
+      readings[i] += 1000;
+
+    if (nEncoderCountRead > 0 && nEncoderRejects[i] < kEncoderMaxRejects &&
+        abs(readings[i] - nEncoderPosition[i]) > kEncoderMaxJump)
+    {
+      // Pretend we read the same as last time.
+      readings[i] = nEncoderPosition[i];
+      nEncoderRejects[i]++;
+      faultDetected(kFaultEncoderGlitch);
+    }
+    else
+    {
+      if (nEncoderRejects[i] > 0)
+        faultRecovered(kFaultEncoderGlitch);
+      nEncoderRejects[i] = 0;
+    }
+
+    if (readings[i] != nEncoderPosition[i])
+      faultRecovered(kFaultEncoderStuck);
+  }
+
+  nEncoderHead = (nEncoderHead + 1) & (kEncoderHistory - 1);
+
+  // The oldest reading is the one we're about to overwrite, unless we haven't
+  // filled the history yet.
+  int oldest = nEncoderCountRead < kEncoderHistory ? 0 : nEncoderHead;
+  long dt = now - nEncoderHistoryTime[oldest];
+
+  for (int i = 0; i < kEncoderCount; i++)
+  {
+    int velocity = nEncoderVelocity[i];
+
+    if (nEncoderCountRead > 0 && dt > 0)
+    {
+      int raw = (readings[i] - nEncoderHistory[i][oldest]) * 1000 / dt;
+      // Low-pass filter, each new reading counts for a quarter.
+      velocity += (raw - velocity) / 4;
+    }
+
+    hogCPU();
+    nEncoderHistory[i][nEncoderHead] = readings[i];
+    nEncoderPosition[i] = readings[i];
+    nEncoderVelocity[i] = velocity;
+    releaseCPU();
+  }
+
+  nEncoderHistoryTime[nEncoderHead] = now;
+  nEncoderCountRead++;
+}
+
+/**
+ * Read the encoders at a fixed rate.
+ */
+task encoderService()
+{
+  while (true)
+  {
+    encoderServiceTick();
+    wait1Msec(kEncoderPeriod);
+  }
+}
+
+/**
+ * Start the encoder service. Reset any encoders before calling this, or the
+ * first velocities will be way off.
+ */
+void encoderServiceStart()
+{
+  // The first tick moves this on to 0.
+  nEncoderHead = kEncoderHistory - 1;
+  nEncoderCountRead = 0;
+  for (int i = 0; i < kEncoderCount; i++)
+  {
+    nEncoderVelocity[i] = 0;
+    nEncoderRejects[i] = 0;
+  }
+
+  encoderServiceTick();
+  StartTask(encoderService);
+}
+
+/**
+ * Make an encoder that was just reset read a given position. Call this before
+ * encoderServiceStart(), or the jump looks like a bad reading.
+ *
+ * @param encoder The encoder (like kEncArm).
+ * @param position Where it should be now, in ticks.
+ */
+void encoderSetPosition(int encoder, long position)
+{
+  nEncoderOffset[encoder] = position;
+}
+
+/**
+ * Get the latest position of an encoder.
+ *
+ * @param encoder The encoder (like kEncArm).
+ * @return The position, in ticks.
+ */
+long encoderPosition(int encoder)
+{
+  hogCPU();
+  long position = nEncoderPosition[encoder];
+  releaseCPU();
+  return position;
+}
+
+/**
+ * Get how fast an encoder is turning.
+ *
+ * @param encoder The encoder (like kEncArm).
+ * @return The filtered velocity, in ticks per second.
+ */
+int encoderVelocity(int encoder)
+{
+  return nEncoderVelocity[encoder];
+}
+
+#endif // __4560_ENCODERS_H__
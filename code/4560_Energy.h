@@ -0,0 +1,187 @@
+/**
+ * Energy accounting for team 4560's robot. This works out roughly how much
+ * energy the drive, the arm and the sweeper take out of the battery over a
+ * match, from what the motors are told to do, how fast they turn, and the
+ * battery level. It can also turn the drive's top power down when the battery
+ * looks like it won't last until the end of the match.
+ * All code written by Henrik Hodne unless otherwise noted. All code by Henrik
+ * Hodne is released under the MIT license (see the LICENSE file).
+ */
+
+
+#ifndef __4560_ENERGY_H__
+#define __4560_ENERGY_H__
+
+#include "4560_Common.h"
+
+// How often (in ms) the energy is added up.
+#define kEnergyPeriod 100
+
+// What a motor draws (mA) when it's stalled at full power, and what the
+// sweeper servo draws at full speed.
+#define kMotorStallCurrent 4600
+#define kSweeperCurrent 500
+
+// The subsystems the energy is split up by.
+#define kEnergyDrive 0
+#define kEnergyArm 1
+#define kEnergySweeper 2
+#define kEnergyCount 3
+
+// How often (in ms) the battery level is sampled to see where it's heading,
+// and how many samples the trend is worked out over.
+#define kEnergySamplePeriod 5000
+#define kEnergySamples 6
+
+// In power budget mode, the drive's top power (percent) is turned down by
+// kEnergyBudgetStep every sample while the battery is heading below
+// kEnergySagLevel (mV) by the end of the match, but never below
+// kEnergyBudgetMin. It's turned back up once the battery looks safe again.
+bool bPowerBudget = false;
+#define kEnergySagLevel 10500
+#define kEnergySagMargin 300
+#define kEnergyBudgetStep 5
+#define kEnergyBudgetMin 50
+
+// Energy used so far this match (J) by each subsystem, and what's left over
+// (mJ) until it adds up to a whole J.
+long nEnergy[kEnergyCount];
+long nEnergyRest[kEnergyCount];
+
+// When the match started and how long it is (ms), and where the battery level
+// looks like it'll be at the end (mV).
+long nEnergyMatchStart = 0;
+long nEnergyMatchTime = 0;
+int nEnergyProjected = 0;
+
+/**
+ * Work out what a motor is drawing from the battery right now.
+ *
+ * @param motorIndex The motor (kEncNW and so on).
+ * @return The current (mA).
+ */
+long energyMotorCurrent(int motorIndex)
+{
+  int power = nThermalPower[motorIndex];
+  long current = power - (((long)encoderVelocity(motorIndex) *
+                          kThermalBackEmf) >> 8);
+  current = clampLong(current, -100, 100);
+
+  // The controller only connects the battery for abs(power) of the time.
+  return abs(current) * abs(power) * kMotorStallCurrent / 10000;
+}
+
+/**
+ * Add the energy used since the last update to a subsystem.
+ *
+ * @param subsystem The subsystem (kEnergyDrive and so on).
+ * @param current What it's drawing (mA).
+ * @param voltage The battery level (mV).
+ * @param dt How long since the last update (ms).
+ */
+void energyAdd(int subsystem, long current, long voltage, long dt)
+{
+  // mV * mA / 1000 is mW, and mW * ms / 1000 is mJ.
+  long energy = nEnergyRest[subsystem] + voltage * current / 1000 * dt / 1000;
+
+  nEnergy[subsystem] += energy / 1000;
+  nEnergyRest[subsystem] = energy % 1000;
+}
+
+/**
+ * Write how much energy has been used to the debug stream.
+ */
+void energyReport()
+{
+  writeDebugStreamLine("energy: drive %d J, arm %d J, sweeper %d J",
+                       nEnergy[kEnergyDrive], nEnergy[kEnergyArm],
+                       nEnergy[kEnergySweeper]);
+}
+
+/**
+ * Add up the energy used, and keep an eye on where the battery is heading.
+ * At the end of the match, the totals are logged.
+ */
+task energyService()
+{
+  int samples[kEnergySamples];
+  int sampleCount = 0;
+  long lastSample = nSysTime;
+  long lastUpdate = nSysTime;
+  bool bReported = false;
+
+  while (true)
+  {
+    wait1Msec(kEnergyPeriod);
+
+    long now = nSysTime;
+    long dt = now - lastUpdate;
+    lastUpdate = now;
+
+    int voltage = getBatteryLevel();
+    if (voltage < 0)
+      continue;
+
+    long drive = energyMotorCurrent(kEncNE) + energyMotorCurrent(kEncNW) +
+                 energyMotorCurrent(kEncSW) + energyMotorCurrent(kEncSE);
+    energyAdd(kEnergyDrive, drive, voltage, dt);
+    energyAdd(kEnergyArm, energyMotorCurrent(kEncArm), voltage, dt);
+
+    int sweeper = servoGet(kServoSweeper);
+    if (sweeper >= 0)
+      energyAdd(kEnergySweeper, (long)abs(sweeper - 128) * kSweeperCurrent /
+                128, voltage, dt);
+
+    long elapsed = now - nEnergyMatchStart;
+    if (!bReported && elapsed >= nEnergyMatchTime)
+    {
+      bReported = true;
+      energyReport();
+      telemetryEvent(kEventEnergy, nEnergy[kEnergyDrive], nEnergy[kEnergyArm]);
+    }
+
+    if (now - lastSample < kEnergySamplePeriod)
+      continue;
+    lastSample = now;
+
+    // Where the battery level will be at the end of the match, if it keeps
+    // going down like it has over the last few samples.
+    int oldest = samples[sampleCount % kEnergySamples];
+    samples[sampleCount % kEnergySamples] = voltage;
+    sampleCount++;
+    if (sampleCount <= kEnergySamples)
+      continue;
+
+    long slope = (long)(voltage - oldest) * 1000 /
+                 ((long)kEnergySamples * kEnergySamplePeriod);
+    long remaining = max(nEnergyMatchTime - elapsed, 0);
+    nEnergyProjected = voltage + slope * remaining / 1000;
+
+    if (!bPowerBudget)
+      nDrivePeak = 100;
+    else if (nEnergyProjected < kEnergySagLevel)
+      nDrivePeak = max(nDrivePeak - kEnergyBudgetStep, kEnergyBudgetMin);
+    else if (nEnergyProjected > kEnergySagLevel + kEnergySagMargin)
+      nDrivePeak = min(nDrivePeak + kEnergyBudgetStep, 100);
+  }
+}
+
+/**
+ * Start counting energy for a new match.
+ *
+ * @param matchTime How long the match is (ms).
+ */
+void energyServiceStart(long matchTime)
+{
+  for (int i = 0; i < kEnergyCount; i++)
+  {
+    nEnergy[i] = 0;
+    nEnergyRest[i] = 0;
+  }
+
+  nEnergyMatchStart = nSysTime;
+  nEnergyMatchTime = matchTime;
+  StartTask(energyService);
+}
+
+#endif // __4560_ENERGY_H__
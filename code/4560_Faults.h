@@ -0,0 +1,233 @@
+/**
+ * Fault injection for team 4560's robot. Define FAULT_INJECTION before
+ * including 4560_Common.h to make the services below misbehave on purpose,
+ * either on a fixed schedule or at random, and to log how long it takes to
+ * notice each fault and to get back to normal after it's gone. Without
+ * FAULT_INJECTION all of this compiles to nothing.
+ *
+ * The services call faultActive() where a fault could happen, and
+ * faultDetected()/faultRecovered() where they notice one, whether it was
+ * injected or real.
+ * All code written by Henrik Hodne unless otherwise noted. All code by Henrik
+ * Hodne is released under the MIT license (see the LICENSE file).
+ */
+
+
+#ifndef __4560_FAULTS_H__
+#define __4560_FAULTS_H__
+
+#include "4560_Telemetry.h"
+
+// Fault types.
+#define kFaultMotorWrite 0      // Writes to the S1 motor controllers get lost
+#define kFaultEncoderStuck 1    // Encoder counts stop changing
+#define kFaultEncoderGlitch 2   // Encoder counts jump around
+#define kFaultCompassDropout 3  // The compass stops answering
+#define kFaultCompassSpike 4    // The compass reads way off
+#define kFaultMessageStall 5    // No new Bluetooth messages
+#define kFaultBrownout 6        // Battery voltage drops
+#define kFaultTypeCount 7
+
+// Battery level (mV) reported during a brownout.
+#define kFaultBrownoutLevel 8500
+
+#ifdef FAULT_INJECTION
+
+// The schedule: fault type, when it starts (ms after faultInjectionStart())
+// and how long it lasts (ms).
+#define kFaultScheduleSize 7
+const int kFaultScheduleType[kFaultScheduleSize] = {
+  kFaultCompassDropout, kFaultCompassSpike, kFaultEncoderGlitch,
+  kFaultEncoderStuck, kFaultMessageStall, kFaultMotorWrite, kFaultBrownout
+};
+const long kFaultScheduleStart[kFaultScheduleSize] = {
+  5000, 10000, 15000, 20000, 25000, 35000, 40000
+};
+const int kFaultScheduleLength[kFaultScheduleSize] = {
+  1000, 40, 50, 2000, 3000, 500, 2000
+};
+
+// Chance (out of 10000) of a random fault of each type starting every time the
+// schedule is checked. 0 turns random faults off. Random faults last between
+// 0 and kFaultRandomLength ms.
+#define kFaultRandomChance 0
+#define kFaultRandomLength 2000
+
+// How often (in ms) the fault schedule is checked, and how often (in ms) the
+// report is written to the debug stream.
+#define kFaultPeriod 10
+#define kFaultReportPeriod 10000
+
+long nFaultStartTime;
+bool bFaultActive[kFaultTypeCount];
+long nFaultInjectedAt[kFaultTypeCount];
+long nFaultClearedAt[kFaultTypeCount];
+long nFaultRandomEnd[kFaultTypeCount];
+bool bFaultDetected[kFaultTypeCount];
+
+// Per fault type: how many were injected and detected, and the total
+// detection latency and recovery time (ms), for working out averages.
+int nFaultInjected[kFaultTypeCount];
+int nFaultDetections[kFaultTypeCount];
+long nFaultDetectionTotal[kFaultTypeCount];
+int nFaultRecoveries[kFaultTypeCount];
+long nFaultRecoveryTotal[kFaultTypeCount];
+
+/**
+ * Check whether a fault is being injected right now.
+ *
+ * @param type The fault type.
+ * @return Whether it's active.
+ */
+bool faultActive(int type)
+{
+  return bFaultActive[type];
+}
+
+/**
+ * Tell the fault log that a fault has been noticed. Only the first call for
+ * each injected fault counts.
+ *
+ * @param type The fault type.
+ */
+void faultDetected(int type)
+{
+  if (nFaultInjectedAt[type] == 0 || bFaultDetected[type])
+    return;
+
+  long latency = nSysTime - nFaultInjectedAt[type];
+  bFaultDetected[type] = true;
+  nFaultDetections[type]++;
+  nFaultDetectionTotal[type] += latency;
+  telemetryEvent(kEventFaultDetected, type, latency);
+}
+
+/**
+ * Tell the fault log that things are back to normal after a fault. Only counts
+ * once the injected fault is over.
+ *
+ * @param type The fault type.
+ */
+void faultRecovered(int type)
+{
+  if (bFaultActive[type] || nFaultClearedAt[type] == 0)
+    return;
+
+  long recovery = nSysTime - nFaultClearedAt[type];
+  nFaultInjectedAt[type] = 0;
+  nFaultClearedAt[type] = 0;
+  nFaultRecoveries[type]++;
+  nFaultRecoveryTotal[type] += recovery;
+  telemetryEvent(kEventFaultRecovered, type, recovery);
+}
+
+/**
+ * Turn a fault on or off, and keep track of when.
+ *
+ * @param type The fault type.
+ * @param bActive Whether it should be active.
+ */
+void faultSet(int type, bool bActive)
+{
+  if (bActive == bFaultActive[type])
+    return;
+
+  bFaultActive[type] = bActive;
+  if (bActive)
+  {
+    nFaultInjectedAt[type] = nSysTime;
+    nFaultClearedAt[type] = 0;
+    bFaultDetected[type] = false;
+    nFaultInjected[type]++;
+    telemetryEvent(kEventFaultInjected, type, 0);
+  }
+  else
+    nFaultClearedAt[type] = nSysTime;
+}
+
+/**
+ * Write the detection latency and recovery time of each fault type to the
+ * debug stream (averages in ms, -1 if never seen).
+ */
+void faultReport()
+{
+  for (int type = 0; type < kFaultTypeCount; type++)
+  {
+    long detection = -1;
+    long recovery = -1;
+
+    if (nFaultDetections[type] > 0)
+      detection = nFaultDetectionTotal[type] / nFaultDetections[type];
+    if (nFaultRecoveries[type] > 0)
+      recovery = nFaultRecoveryTotal[type] / nFaultRecoveries[type];
+
+    writeDebugStreamLine("fault %d: %d injected, %d detected, %d ms, %d ms",
+                         type, nFaultInjected[type], nFaultDetections[type],
+                         detection, recovery);
+  }
+}
+
+/**
+ * Turn faults on and off according to the schedule and the random faults, and
+ * write the report every now and then.
+ */
+task faultInjection()
+{
+  long lastReport = nSysTime;
+
+  while (true)
+  {
+    long now = nSysTime;
+    long t = now - nFaultStartTime;
+
+    if (now - lastReport >= kFaultReportPeriod)
+    {
+      faultReport();
+      lastReport = now;
+    }
+
+    for (int type = 0; type < kFaultTypeCount; type++)
+    {
+      bool bActive = now < nFaultRandomEnd[type];
+
+      for (int i = 0; i < kFaultScheduleSize; i++)
+      {
+        if (kFaultScheduleType[i] == type && t >= kFaultScheduleStart[i] &&
+            t < kFaultScheduleStart[i] + kFaultScheduleLength[i])
+          bActive = true;
+      }
+
+      if (!bActive && kFaultRandomChance > 0 &&
+          random(10000) < kFaultRandomChance)
+      {
+        nFaultRandomEnd[type] = now + random(kFaultRandomLength);
+        bActive = true;
+      }
+
+      faultSet(type, bActive);
+    }
+
+    wait1Msec(kFaultPeriod);
+  }
+}
+
+/**
+ * Start injecting faults. The schedule starts counting from now.
+ */
+void faultInjectionStart()
+{
+  nFaultStartTime = nSysTime;
+  StartTask(faultInjection);
+}
+
+#else
+
+#define faultActive(type) false
+#define faultDetected(type)
+#define faultRecovered(type)
+#define faultInjectionStart()
+#define faultReport()
+
+#endif // FAULT_INJECTION
+
+#endif // __4560_FAULTS_H__
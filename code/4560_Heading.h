@@ -0,0 +1,167 @@
+/**
+ * Heading service for team 4560's robot. This owns the compass and is the only
+ * thing that should talk to it; everything else reads the cached heading.
+ * All code written by Henrik Hodne unless otherwise noted. All code by Henrik
+ * Hodne is released under the MIT license (see the LICENSE file).
+ */
+
+
+#ifndef __4560_HEADING_H__
+#define __4560_HEADING_H__
+
+#include "HTMC-driver.h"
+#include "4560_Control.h"
+#include "4560_Faults.h"
+
+// How often (in ms) the heading service reads the compass. Every read is an
+// I2C transaction, so don't make this much faster than the compass updates.
+#define kHeadingPeriod 20
+
+// The heading counts as stale (the compass stopped answering) after this many
+// ms without a good reading.
+#define kHeadingStaleAge 100
+
+// The robot can't turn further than this (in degrees) between two readings,
+// so a bigger jump is a bad reading. If it happens kHeadingMaxRejects times in
+// a row it's probably real (like after the compass was out for a while).
+#define kHeadingMaxJump 30
+#define kHeadingMaxRejects 3
+
+// The latest heading from the compass (0˚ is N), and when it was read.
+int nHeading = 0;
+long nHeadingTime = 0;
+
+// Counts the readings, so consumers can tell when there's a new one.
+long nHeadingCount = 0;
+
+// How fast (degrees/s) the heading is changing, averaged over the last few
+// readings. Positive is towards higher headings.
+int nHeadingRate = 0;
+
+/**
+ * Read the compass at a fixed rate and cache the result. Failed reads and
+ * readings that jump too far are dropped, which makes the cached heading older
+ * (see getHeadingAge()).
+ */
+task headingService()
+{
+  int rejects = 0;
+  bool bStale = false;
+
+  while (true)
+  {
+    int reading = HTMCreadHeading(sensorCompass);
+
+    if (faultActive(kFaultCompassDropout))
+      reading = -1;
+    else if (faultActive(kFaultCompassSpike) && reading >= 0)
+      reading = (reading + 180) % 360;
+
+    if (reading >= 0 && nHeadingCount > 0 && rejects < kHeadingMaxRejects &&
+        abs(headingError(reading, nHeading)) > kHeadingMaxJump)
+    {
+      rejects++;
+      faultDetected(kFaultCompassSpike);
+    }
+    else if (reading >= 0)
+    {
+      if (rejects > 0)
+        faultRecovered(kFaultCompassSpike);
+      rejects = 0;
+
+      int rate = 0;
+      long dt = nSysTime - nHeadingTime;
+      if (nHeadingCount > 0 && dt > 0)
+        rate = (nHeadingRate +
+                (long)headingError(reading, nHeading) * 1000 / dt) / 2;
+
+      hogCPU();
+      nHeading = reading;
+      nHeadingRate = rate;
+      nHeadingTime = nSysTime;
+      nHeadingCount++;
+      releaseCPU();
+    }
+
+    if (nSysTime - nHeadingTime > kHeadingStaleAge)
+    {
+      bStale = true;
+      faultDetected(kFaultCompassDropout);
+    }
+    else if (bStale)
+    {
+      bStale = false;
+      faultRecovered(kFaultCompassDropout);
+    }
+
+    wait1Msec(kHeadingPeriod);
+  }
+}
+
+/**
+ * Start the heading service and wait (at most a second) for the first reading.
+ */
+void headingServiceStart()
+{
+  StartTask(headingService);
+
+  for (int i = 0; i < 1000 / kHeadingPeriod && nHeadingCount == 0; i++)
+    wait1Msec(kHeadingPeriod);
+}
+
+/**
+ * Get the latest heading.
+ *
+ * @return The latest heading read from the compass, 0˚ is N.
+ */
+int getHeading()
+{
+  return nHeading;
+}
+
+/**
+ * Get how old the latest heading is.
+ *
+ * @return The number of milliseconds since the heading was read.
+ */
+long getHeadingAge()
+{
+  hogCPU();
+  long age = nSysTime - nHeadingTime;
+  releaseCPU();
+  return age;
+}
+
+/**
+ * Check whether the latest heading is fresh enough to use.
+ *
+ * @param maxAge The oldest heading (in ms) the caller is happy with.
+ * @return Whether the heading was read less than maxAge ms ago.
+ */
+bool headingIsFresh(long maxAge)
+{
+  return nHeadingCount > 0 && getHeadingAge() <= maxAge;
+}
+
+/**
+ * Wait until the heading service has a newer reading than a given one. This
+ * gives up if the heading gets too old, so a dead compass can't hang the
+ * caller.
+ *
+ * @param lastCount The value of nHeadingCount when the caller last read.
+ * @param maxAge The oldest heading (in ms) to wait around with.
+ * @return Whether there's a newer reading (false if the heading went stale).
+ */
+bool waitForNewHeading(long lastCount, long maxAge)
+{
+  while (nHeadingCount == lastCount)
+  {
+    if (getHeadingAge() > maxAge)
+      return false;
+    wait1Msec(kHeadingPeriod / 4);
+  }
+
+  return true;
+}
+
+#endif // __4560_HEADING_H__
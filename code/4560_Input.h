@@ -0,0 +1,132 @@
+/**
+ * Input map for team 4560's robot. Instead of checking every button on every
+ * loop, the buttons and TopHat positions are mapped to actions in a table.
+ * The table is kept in the calibration file, so the drivers can remap the
+ * controls without recompiling, and only the inputs that changed with a new
+ * joystick message are looked up.
+ * All code written by Henrik Hodne unless otherwise noted. All code by Henrik
+ * Hodne is released under the MIT license (see the LICENSE file).
+ */
+
+
+#ifndef __4560_INPUT_H__
+#define __4560_INPUT_H__
+
+// Inputs. Buttons are numbered like on the controller (1 to 12), the TopHat
+// positions come after them (13 + the TopHat value, 21 when it's idle). Input
+// n is bit n - 1 of an input mask.
+#define kInputTopHat 13
+#define kInputTopHatUp 13
+#define kInputTopHatDown 17
+#define kInputTopHatIdle 21
+#define kInputCount 21
+
+// Events.
+#define kEventPress 0    // The input went down
+#define kEventRelease 1  // The input went up
+#define kEventHold 2     // Every message while the input is down
+#define kEventCount 3
+
+// Actions. What they actually do is up to the program using the map.
+#define kActionNone 0
+#define kActionSweeperOn 1
+#define kActionSweeperOff 2
+#define kActionSweeperReverse 3
+#define kActionArmStepUp 4
+#define kActionArmStepDown 5
+#define kActionScoopUp 6
+#define kActionScoopDown 7
+#define kActionArmUp 8
+#define kActionArmDown 9
+#define kActionArmIdle 10
+#define kActionArmFastOn 11
+#define kActionArmFastOff 12
+#define kActionTeachOn 13
+#define kActionTeachOff 14
+#define kActionPreset1 15
+#define kActionPreset2 16
+#define kActionPreset3 17
+
+// The map used when there's no calibration file, as (controller, input,
+// event, action).
+#define kDefaultInputMapSize 17
+const int kDefaultInputMap[kDefaultInputMapSize * 4] =
+{
+  2, 2,  kEventPress,   kActionSweeperOn,
+  2, 4,  kEventPress,   kActionSweeperReverse,
+  2, 3,  kEventPress,   kActionSweeperOff,
+  2, 6,  kEventHold,    kActionArmStepUp,
+  2, 8,  kEventHold,    kActionArmStepDown,
+  2, 9,  kEventHold,    kActionScoopUp,
+  2, 10, kEventHold,    kActionScoopDown,
+  2, 1,  kEventPress,   kActionArmFastOn,
+  2, 1,  kEventRelease, kActionArmFastOff,
+  2, kInputTopHatUp,   kEventPress, kActionArmUp,
+  2, kInputTopHatDown, kEventPress, kActionArmDown,
+  2, kInputTopHatIdle, kEventPress, kActionArmIdle,
+  2, 5,  kEventPress,   kActionTeachOn,
+  2, 5,  kEventRelease, kActionTeachOff,
+  2, 7,  kEventPress,   kActionPreset1,
+  2, 11, kEventPress,   kActionPreset2,
+  2, 12, kEventPress,   kActionPreset3
+};
+
+// The map, as a lookup table of actions for each controller, input and event,
+// plus a mask of the inputs with hold actions. ROBOTC only does arrays of up
+// to two dimensions, so input and event share one: the action for input n
+// (counting from 0) and an event is at n * kEventCount + event.
+int nInputAction[2][kInputCount * kEventCount];
+long nInputHoldMask[2];
+
+/**
+ * Remove everything from the input map.
+ */
+void inputMapClear()
+{
+  for (int controller = 0; controller < 2; controller++)
+  {
+    nInputHoldMask[controller] = 0;
+    for (int i = 0; i < kInputCount * kEventCount; i++)
+      nInputAction[controller][i] = kActionNone;
+  }
+}
+
+/**
+ * Add an entry to the input map. Bad entries are ignored.
+ *
+ * @param controller The controller (1 or 2).
+ * @param input The input (see the kInput constants).
+ * @param event The event (see the kEvent constants).
+ * @param action The action (see the kAction constants).
+ */
+void inputMapAdd(int controller, int input, int event, int action)
+{
+  if (controller < 1 || controller > 2 || input < 1 || input > kInputCount ||
+      event < 0 || event >= kEventCount || action == kActionNone)
+    return;
+
+  nInputAction[controller - 1][(input - 1) * kEventCount + event] = action;
+  if (event == kEventHold)
+    nInputHoldMask[controller - 1] |= 1L << (input - 1);
+}
+
+/**
+ * Make an input mask out of a controller's buttons and TopHat.
+ *
+ * @param buttons The controller's button mask.
+ * @param topHat The controller's TopHat value (-1 when idle).
+ * @return The input mask.
+ */
+long inputMask(short buttons, int topHat)
+{
+  long mask = buttons & 0x0FFF;
+
+  if (topHat < 0)
+    mask |= 1L << (kInputTopHatIdle - 1);
+  else
+    mask |= 1L << (kInputTopHat + topHat - 1);
+
+  return mask;
+}
+
+#endif // __4560_INPUT_H__
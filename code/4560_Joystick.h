@@ -0,0 +1,115 @@
+/**
+ * Joystick snapshots for team 4560's robot. getJoystickSettings() copies the
+ * whole joystick struct, for both controllers, every time it's called. This
+ * only copies the fields we actually use, and only when a new message has come
+ * in. Which buttons went up or down is left to the input map (see
+ * dispatchInputs() in 4560_TeleOp.c), so it's worked out in one place.
+ * All code written by Henrik Hodne unless otherwise noted. All code by Henrik
+ * Hodne is released under the MIT license (see the LICENSE file).
+ */
+
+
+#ifndef __4560_JOYSTICK_H__
+#define __4560_JOYSTICK_H__
+
+// Where the joystick messages come from. Normally that's the FCS, through
+// JoystickDriver.c, but with SCRIPTED_DRIVER defined they come from the
+// scripted driver instead (see 4560_Driver.h).
+#ifdef SCRIPTED_DRIVER
+TJoystick scriptJoystick;
+long nScriptMessageCount = 0;
+#define joystickSource scriptJoystick
+#define joystickMessageCount nScriptMessageCount
+#else
+#define joystickSource joystickCopy
+#define joystickMessageCount ntotalMessageCount
+#endif
+
+/**
+ * The parts of a joystick message we use. Each task keeps its own, so they
+ * don't step on each other. The buttons are bit masks, button n is bit n - 1.
+ */
+typedef struct
+{
+  long messageCount;  // joystickMessageCount when this was taken
+  int joy1_x1;
+  int joy1_y1;
+  int joy1_x2;
+  int joy1_TopHat;
+  int joy2_y1;
+  int joy2_TopHat;
+  short buttons1;
+  short buttons2;
+} TJoySnapshot;
+
+/**
+ * Check whether a button is set in a button mask.
+ *
+ * @param buttons The button mask (like buttons1 or buttons2).
+ * @param n The button number, as printed on the controller.
+ */
+#define btnIn(buttons, n) (((buttons) & (1 << ((n) - 1))) != 0)
+
+/**
+ * Set up a joystick snapshot. Nothing is pressed until the first message.
+ *
+ * @param snap The snapshot to set up.
+ */
+void joystickInit(TJoySnapshot &snap)
+{
+  snap.messageCount = -1;
+  snap.joy1_x1 = 0;
+  snap.joy1_y1 = 0;
+  snap.joy1_x2 = 0;
+  snap.joy1_TopHat = TopHat_Idle;
+  snap.joy2_y1 = 0;
+  snap.joy2_TopHat = TopHat_Idle;
+  snap.buttons1 = 0;
+  snap.buttons2 = 0;
+}
+
+/**
+ * Update a joystick snapshot if a new message has come in since last time.
+ *
+ * @param snap The snapshot to update.
+ * @return Whether there was a new message.
+ */
+bool joystickUpdate(TJoySnapshot &snap)
+{
+  if (joystickMessageCount == snap.messageCount)
+    return false;
+
+  // JoystickDriver.c updates joystickCopy with the CPU hogged too (and so
+  // does the scripted driver), so this gets all the fields from the same
+  // message.
+  hogCPU();
+  snap.messageCount = joystickMessageCount;
+  snap.joy1_x1 = joystickSource.joy1_x1;
+  snap.joy1_y1 = joystickSource.joy1_y1;
+  snap.joy1_x2 = joystickSource.joy1_x2;
+  snap.joy1_TopHat = joystickSource.joy1_TopHat;
+  snap.joy2_y1 = joystickSource.joy2_y1;
+  snap.joy2_TopHat = joystickSource.joy2_TopHat;
+  snap.buttons1 = joystickSource.joy1_Buttons;
+  snap.buttons2 = joystickSource.joy2_Buttons;
+  releaseCPU();
+
+  return true;
+}
+
+/**
+ * Check whether the match has started: the FCS (or the scripted driver) is
+ * sending messages, and they don't say to hold the program.
+ *
+ * @return Whether the match has started.
+ */
+bool joystickMatchStarted()
+{
+  hogCPU();
+  bool bStarted = joystickMessageCount > 0 && !joystickSource.StopPgm;
+  releaseCPU();
+
+  return bStarted;
+}
+
+#endif // __4560_JOYSTICK_H__
@@ -0,0 +1,294 @@
+/**
+ * Pose estimator for team 4560's robot. This is a small extended Kalman
+ * filter that works out where the robot is on the field (x, y and heading)
+ * from wheel odometry, and corrects the heading (and, through the covariance,
+ * the position) with the compass. Everything is fixed-point: positions are in
+ * cm and headings in degrees, both in Q8 (see 4560_Control.h).
+ * All code written by Henrik Hodne unless otherwise noted. All code by Henrik
+ * Hodne is released under the MIT license (see the LICENSE file).
+ */
+
+
+#ifndef __4560_POSE_H__
+#define __4560_POSE_H__
+
+#include "4560_Common.h"
+
+// How often (in ms) the filter runs, and the average time (in µs) a step is
+// allowed to take before it's logged as over budget.
+#define kPosePeriod 20
+#define kPoseBudget 2000
+
+// Encoder ticks (as worked out by driveOdometry()) per degree the robot spins.
+// Positive turns are the same way as spin(), which turns to higher headings.
+#define kTurnTicksPerDegree 12
+
+// Noise (Q8): position variance (cm²) added per cm driven, heading variance
+// (deg²) added per degree turned and per step, and the compass's variance.
+#define kPoseOdoNoise 13
+#define kPoseTurnNoise 26
+#define kPoseHeadingDrift 1
+#define kPoseCompassNoise 1024
+
+// Compass readings further than this (in degrees) from where we think we're
+// pointing, and more than three standard deviations off, are ignored.
+#define kPoseGate 20
+
+// Limits for the covariance (Q8), so nothing overflows if the compass is out
+// for a long time.
+#define kPoseMaxVariance 2560000
+#define kPoseMaxHeadingVariance 8294400
+
+// The pose: x (cm "East"), y (cm "North"), heading (degrees, 0 is N), all Q8.
+long nPoseX = 0;
+long nPoseY = 0;
+long nPoseHeading = 0;
+
+// The covariance (Q8), as xx, xy, xh, yy, yh, hh.
+#define kPxx 0
+#define kPxy 1
+#define kPxh 2
+#define kPyy 3
+#define kPyh 4
+#define kPhh 5
+long nPoseCov[6];
+
+// CPU time spent in the filter.
+long nPoseSteps = 0;
+long nPoseCpuTime = 0;
+bool bPoseOverBudget = false;
+
+long nPoseLastX, nPoseLastY, nPoseLastTurn;
+long nPoseLastHeadingCount;
+
+/**
+ * Multiply a Q8 number that might be big by one that's small, without
+ * overflowing on the way.
+ *
+ * @param a The big number (Q8).
+ * @param b The small number (Q8, less than 2^15).
+ * @return a * b (Q8).
+ */
+long mulQ8(long a, long b)
+{
+  return (a >> 8) * b + (((a & 255) * b) >> 8);
+}
+
+/**
+ * Start the filter at a given place, pointing the way the compass says, with
+ * no doubt about the position.
+ *
+ * @param x Where the robot is (cm "East").
+ * @param y Where the robot is (cm "North").
+ */
+void poseReset(int x, int y)
+{
+  long turn;
+
+  hogCPU();
+  nPoseX = (long)x << 8;
+  nPoseY = (long)y << 8;
+  nPoseHeading = (long)getHeading() << 8;
+  for (int i = 0; i < 6; i++)
+    nPoseCov[i] = 0;
+  nPoseCov[kPhh] = kPoseCompassNoise;
+  releaseCPU();
+
+  driveOdometry(nPoseLastX, nPoseLastY, turn);
+  nPoseLastTurn = turn;
+  nPoseLastHeadingCount = nHeadingCount;
+}
+
+/**
+ * Keep the pose's heading between 0 and 360 degrees.
+ */
+void poseWrapHeading()
+{
+  if (nPoseHeading < 0)
+    nPoseHeading += 360L << 8;
+  else if (nPoseHeading >= 360L << 8)
+    nPoseHeading -= 360L << 8;
+}
+
+/**
+ * Keep a covariance entry inside its limits.
+ *
+ * @param i The entry (like kPxx).
+ * @param limit The largest size it can have (Q8).
+ */
+void poseLimit(int i, long limit)
+{
+  nPoseCov[i] = clampLong(nPoseCov[i], -limit, limit);
+}
+
+/**
+ * Predict where the robot is now from how far the wheels turned.
+ */
+void posePredict()
+{
+  long x, y, turn;
+  driveOdometry(x, y, turn);
+
+  // How far we moved, in the robot's own frame (Q8).
+  long dxr = ((x - nPoseLastX) << 8) / kDriveTicksPerCm;
+  long dyr = ((y - nPoseLastY) << 8) / kDriveTicksPerCm;
+  long dh = ((turn - nPoseLastTurn) << 8) / kTurnTicksPerDegree;
+  nPoseLastX = x;
+  nPoseLastY = y;
+  nPoseLastTurn = turn;
+
+#ifdef POSE_GYRO
+  // The gyro is better at turns than the wheels are. sensorGyro has to be set
+  // up in the program's config, and kGyroOffset is its reading at rest.
+  dh = ((long)(SensorValue[sensorGyro] - kGyroOffset) << 8) * kPosePeriod /
+       1000;
+#endif
+
+  // Turn the move into field coordinates, using the heading halfway through.
+  int h = (nPoseHeading + dh / 2) >> 8;
+  long s = sinQ14(h);
+  long c = cosQ14(h);
+  long dX = (dxr * c + dyr * s) >> 14;
+  long dY = (dyr * c - dxr * s) >> 14;
+
+  // How the move changes with the heading (cm/degree, Q8). Turning the move
+  // by a small angle a (radians) adds a * dY to dX and takes a * dX off dY,
+  // and a degree is pi/180 radians (286 in Q14).
+  long fX = dY * 286 >> 14;
+  long fY = -dX * 286 >> 14;
+
+  long P[6];
+  for (int i = 0; i < 6; i++)
+    P[i] = nPoseCov[i];
+
+  // P = F P F' + Q, with F = [1 0 fX; 0 1 fY; 0 0 1].
+  long fXhh = mulQ8(P[kPhh], fX);
+  long fYhh = mulQ8(P[kPhh], fY);
+  long distance = abs(dxr) + abs(dyr);
+  long qPos = mulQ8(distance, kPoseOdoNoise);
+
+  hogCPU();
+  nPoseX += dX;
+  nPoseY += dY;
+  nPoseHeading += dh;
+  poseWrapHeading();
+  nPoseCov[kPxx] = P[kPxx] + 2 * mulQ8(P[kPxh], fX) + mulQ8(fXhh, fX) + qPos;
+  nPoseCov[kPxy] = P[kPxy] + mulQ8(P[kPyh], fX) + mulQ8(P[kPxh], fY) +
+                   mulQ8(fXhh, fY);
+  nPoseCov[kPxh] = P[kPxh] + fXhh;
+  nPoseCov[kPyy] = P[kPyy] + 2 * mulQ8(P[kPyh], fY) + mulQ8(fYhh, fY) + qPos;
+  nPoseCov[kPyh] = P[kPyh] + fYhh;
+  nPoseCov[kPhh] = P[kPhh] + mulQ8(abs(dh), kPoseTurnNoise) +
+                   kPoseHeadingDrift;
+  releaseCPU();
+
+  poseLimit(kPxx, kPoseMaxVariance);
+  poseLimit(kPxy, kPoseMaxVariance);
+  poseLimit(kPyy, kPoseMaxVariance);
+  poseLimit(kPxh, kPoseMaxVariance);
+  poseLimit(kPyh, kPoseMaxVariance);
+  poseLimit(kPhh, kPoseMaxHeadingVariance);
+}
+
+/**
+ * Correct the pose with a compass reading.
+ *
+ * @param heading The compass heading (degrees).
+ */
+void poseUpdate(int heading)
+{
+  int whole = nPoseHeading >> 8;
+  long innovation = ((long)headingError(heading, whole) << 8) -
+                    (nPoseHeading - ((long)whole << 8));
+
+  long P[6];
+  for (int i = 0; i < 6; i++)
+    P[i] = nPoseCov[i];
+
+  // K = P H' / (H P H' + R), with H = [0 0 1] (all Q8).
+  long S = P[kPhh] + kPoseCompassNoise;
+
+  long degrees = abs(innovation >> 8);
+  if (degrees > kPoseGate && degrees * degrees > 9 * (S >> 8))
+    return;
+
+  long kX = clampLong((P[kPxh] << 8) / S, -32000, 32000);
+  long kY = clampLong((P[kPyh] << 8) / S, -32000, 32000);
+  long kH = (P[kPhh] << 8) / S;
+
+  hogCPU();
+  nPoseX += mulQ8(innovation, kX);
+  nPoseY += mulQ8(innovation, kY);
+  nPoseHeading += mulQ8(innovation, kH);
+
+  // P = (I - K H) P
+  nPoseCov[kPxx] = P[kPxx] - mulQ8(P[kPxh], kX);
+  nPoseCov[kPxy] = P[kPxy] - mulQ8(P[kPyh], kX);
+  nPoseCov[kPxh] = P[kPxh] - mulQ8(P[kPhh], kX);
+  nPoseCov[kPyy] = P[kPyy] - mulQ8(P[kPyh], kY);
+  nPoseCov[kPyh] = P[kPyh] - mulQ8(P[kPhh], kY);
+  nPoseCov[kPhh] = P[kPhh] - mulQ8(P[kPhh], kH);
+  poseWrapHeading();
+  releaseCPU();
+}
+
+/**
+ * Run the filter at a fixed rate, and keep track of how much CPU it uses.
+ */
+task poseEstimator()
+{
+  while (true)
+  {
+    long start = nSysTime;
+
+    posePredict();
+    if (nHeadingCount != nPoseLastHeadingCount)
+    {
+      nPoseLastHeadingCount = nHeadingCount;
+      poseUpdate(getHeading());
+    }
+
+    nPoseCpuTime += nSysTime - start;
+    nPoseSteps++;
+
+    if (!bPoseOverBudget && nPoseSteps >= 100 &&
+        nPoseCpuTime * 1000 / nPoseSteps > kPoseBudget)
+    {
+      bPoseOverBudget = true;
+      telemetryEvent(kEventPoseOverBudget, nPoseCpuTime * 1000 / nPoseSteps,
+                     kPoseBudget);
+    }
+
+    wait1Msec(kPosePeriod);
+  }
+}
+
+/**
+ * Start the pose estimator at a given place (see poseReset()).
+ *
+ * @param x Where the robot is (cm "East").
+ * @param y Where the robot is (cm "North").
+ */
+void poseEstimatorStart(int x, int y)
+{
+  poseReset(x, y);
+  StartTask(poseEstimator);
+}
+
+/**
+ * Get the latest pose.
+ *
+ * @param x Set to the x position (cm "East", Q8).
+ * @param y Set to the y position (cm "North", Q8).
+ * @param heading Set to the heading (degrees, Q8, 0 is N).
+ */
+void getPose(long &x, long &y, long &heading)
+{
+  hogCPU();
+  x = nPoseX;
+  y = nPoseY;
+  heading = nPoseHeading;
+  releaseCPU();
+}
+
+#endif // __4560_POSE_H__
@@ -0,0 +1,219 @@
+/**
+ * Ultrasonic range service for team 4560's robot. This samples the ultrasonic
+ * sensor as fast as it measures, keeps the last few readings in a ring and
+ * serves their median, so single bad echoes don't matter. It also has a
+ * controller for holding the robot a given distance from a wall.
+ *
+ * The sensor has to be set up as sensorSonar in the program's config, and
+ * face "North" (the robot's front).
+ * All code written by Henrik Hodne unless otherwise noted. All code by Henrik
+ * Hodne is released under the MIT license (see the LICENSE file).
+ */
+
+
+#ifndef __4560_RANGE_H__
+#define __4560_RANGE_H__
+
+#include "4560_Common.h"
+
+// How often (in ms) the sensor is sampled. It doesn't measure faster than
+// this.
+#define kRangePeriod 30
+
+// How many readings the median is taken over. Must be odd.
+#define kRangeSamples 5
+
+// The sensor reads this when there's no echo.
+#define kRangeNoEcho 255
+
+// The range counts as stale after this many ms without a good reading.
+#define kRangeStaleAge 200
+
+int nRangeRing[kRangeSamples];
+int nRangeHead = 0;
+int nRangeFilled = 0;
+int nRange = -1;
+long nRangeTime = 0;
+long nRangeCount = 0;
+
+/**
+ * Work out the median of the readings in the ring.
+ *
+ * @return The median reading (cm).
+ */
+int rangeMedian()
+{
+  int sorted[kRangeSamples];
+  int n = nRangeFilled;
+
+  // Insertion sort, there are only a handful.
+  for (int i = 0; i < n; i++)
+  {
+    int value = nRangeRing[i];
+    int j = i;
+    while (j > 0 && sorted[j - 1] > value)
+    {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = value;
+  }
+
+  return sorted[n / 2];
+}
+
+/**
+ * Sample the ultrasonic sensor at a fixed rate. Readings without an echo are
+ * dropped.
+ */
+task rangeService()
+{
+  while (true)
+  {
+    int reading = SensorValue[sensorSonar];
+
+    if (reading >= 0 && reading < kRangeNoEcho)
+    {
+      nRangeRing[nRangeHead] = reading;
+      nRangeHead = (nRangeHead + 1) % kRangeSamples;
+      if (nRangeFilled < kRangeSamples)
+        nRangeFilled++;
+
+      int median = rangeMedian();
+
+      hogCPU();
+      nRange = median;
+      nRangeTime = nSysTime;
+      nRangeCount++;
+      releaseCPU();
+    }
+
+    wait1Msec(kRangePeriod);
+  }
+}
+
+/**
+ * Start the range service.
+ */
+void rangeServiceStart()
+{
+  nRangeFilled = 0;
+  nRangeHead = 0;
+  StartTask(rangeService);
+}
+
+/**
+ * Get the filtered distance to whatever the ultrasonic sensor is facing.
+ *
+ * @return The distance (cm), or -1 if there's no recent reading.
+ */
+int getRange()
+{
+  hogCPU();
+  int range = nRange;
+  long age = nSysTime - nRangeTime;
+  releaseCPU();
+
+  if (nRangeCount == 0 || age > kRangeStaleAge)
+    return -1;
+  return range;
+}
+
+// Gains for holding a distance from a wall (Q8), the top speed to do it at,
+// and how close (in cm) is close enough.
+#define kWallKP 1024
+#define kWallKI 8
+#define kWallKD 512
+#define kWallMaxSpeed 60
+#define kWallTolerance 1
+
+TPid wallPid;
+long nWallLastCount = -1;
+int nWallSpeed = 0;
+
+/**
+ * Get the wall controller ready. Call this before starting to use
+ * wallHoldStep().
+ */
+void wallHoldReset()
+{
+  pidInit(wallPid, kWallKP, kWallKI, kWallKD, -kWallMaxSpeed, kWallMaxSpeed);
+  nWallLastCount = -1;
+  nWallSpeed = 0;
+}
+
+/**
+ * Work out how fast to drive towards the wall the ultrasonic sensor faces, to
+ * end up a given distance from it. This doesn't block and doesn't move
+ * anything, so the result can be fed to drive() along with anything else. The
+ * controller is only updated when there's a new reading.
+ *
+ * @param distance How far (in cm) from the wall to stay.
+ * @return The speed towards the wall (negative is away), 0 if there's no
+ *         reading.
+ */
+int wallHoldStep(int distance)
+{
+  if (nRangeCount == nWallLastCount)
+    return nWallSpeed;
+  nWallLastCount = nRangeCount;
+
+  int range = getRange();
+  if (range < 0)
+    nWallSpeed = 0;
+  else if (abs(range - distance) <= kWallTolerance)
+  {
+    pidUpdate(wallPid, distance, range);
+    nWallSpeed = 0;
+  }
+  else
+    nWallSpeed = -pidUpdate(wallPid, distance, range);
+
+  return nWallSpeed;
+}
+
+/**
+ * Check whether the robot is holding its distance from the wall.
+ *
+ * @param distance How far (in cm) from the wall it should be.
+ * @return Whether it's within kWallTolerance of that.
+ */
+bool wallHoldDone(int distance)
+{
+  int range = getRange();
+  return range >= 0 && abs(range - distance) <= kWallTolerance;
+}
+
+/**
+ * Drive straight to a given distance from the wall in front, holding the
+ * current heading, and wait until the robot is there.
+ *
+ * @param distance How far (in cm) from the wall to stop.
+ * @param timeout How long (in ms) to try.
+ * @return Whether the robot got there before the timeout.
+ */
+bool driveToWall(int distance, long timeout)
+{
+  long start = nSysTime;
+  int heading = getHeading();
+
+  wallHoldReset();
+  headingControllerReset();
+
+  while (!wallHoldDone(distance))
+  {
+    if (nSysTime - start > timeout)
+    {
+      spin(0);
+      return false;
+    }
+
+    drive(0, wallHoldStep(distance), headingControllerStep(heading));
+    wait1Msec(kRangePeriod / 2);
+  }
+
+  spin(0);
+  return true;
+}
+
+#endif // __4560_RANGE_H__
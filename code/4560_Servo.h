@@ -0,0 +1,128 @@
+/**
+ * Servo layer for team 4560's robot. The positions of all the servos are kept
+ * in RAM (the shadow), so reading a servo position doesn't have to ask the
+ * servo controller, and writes are collected and sent once per servo
+ * controller frame, only for the servos that actually changed. Everything
+ * else should use servoSet() and servoGet() instead of servo[] and
+ * ServoValue[].
+ * All code written by Henrik Hodne unless otherwise noted. All code by Henrik
+ * Hodne is released under the MIT license (see the LICENSE file).
+ */
+
+
+#ifndef __4560_SERVO_H__
+#define __4560_SERVO_H__
+
+#include "4560_Control.h"
+
+// How often (in ms) changed positions are sent. The servo controller doesn't
+// update the servos faster than this anyway.
+#define kServoFramePeriod 20
+
+// How often (in ms) the write counts are written to the debug stream.
+#define kServoReportPeriod 10000
+
+// The servos.
+#define kServoCount 3
+#define kServoCompass 0
+#define kServoScoop 1
+#define kServoSweeper 2
+TServoIndex nServoChannels[kServoCount] = {servoCompass, servoScoop,
+                                           servoSweeper};
+
+// Where each servo should be, and what was last sent to it (-1 if nothing).
+int nServoShadow[kServoCount];
+int nServoSent[kServoCount];
+
+// How many writes were asked for, and how many were actually sent. Before the
+// shadow every write was sent (and most of them read the position first).
+long nServoWrites = 0;
+long nServoTransmits = 0;
+
+/**
+ * Set where a servo should be. It's sent with the next frame.
+ *
+ * @param index The servo (like kServoScoop).
+ * @param position The position (0 to 255).
+ */
+void servoSet(int index, int position)
+{
+  nServoShadow[index] = clampLong(position, 0, 255);
+  nServoWrites++;
+}
+
+/**
+ * Get where a servo should be. This doesn't talk to the servo controller.
+ *
+ * @param index The servo (like kServoScoop).
+ * @return The last position set with servoSet().
+ */
+int servoGet(int index)
+{
+  return nServoShadow[index];
+}
+
+/**
+ * Send the positions that changed since the last frame. The servo service
+ * does this, but call it directly for things that can't wait (like stopping
+ * the sweeper).
+ */
+void servoFlush()
+{
+  hogCPU();
+  for (int i = 0; i < kServoCount; i++)
+  {
+    if (nServoShadow[i] != nServoSent[i])
+    {
+      servo[nServoChannels[i]] = nServoShadow[i];
+      nServoSent[i] = nServoShadow[i];
+      nServoTransmits++;
+    }
+  }
+  releaseCPU();
+}
+
+/**
+ * Send changed servo positions once per frame.
+ */
+task servoService()
+{
+  long lastReport = nSysTime;
+
+  while (true)
+  {
+    servoFlush();
+
+    if (nSysTime - lastReport >= kServoReportPeriod)
+    {
+      writeDebugStreamLine("servos: %d writes, %d sent", nServoWrites,
+                           nServoTransmits);
+      lastReport = nSysTime;
+    }
+
+    wait1Msec(kServoFramePeriod);
+  }
+}
+
+/**
+ * Start the servo service. Servos set before this are sent right away.
+ */
+void servoServiceStart()
+{
+  servoFlush();
+  StartTask(servoService);
+}
+
+/**
+ * Set up the shadow. Nothing is sent until a position is set.
+ */
+void servoInit()
+{
+  for (int i = 0; i < kServoCount; i++)
+  {
+    nServoShadow[i] = -1;
+    nServoSent[i] = -1;
+  }
+}
+
+#endif // __4560_SERVO_H__
@@ -1,11 +1,12 @@
 #pragma config(Hubs,  S1, HTMotor,  HTMotor,  HTMotor,  HTServo)
 #pragma config(Sensor, S2,     sensorCompass,       sensorI2CHiTechnicCompass)
-#pragma config(Motor,  mtr_S1_C1_1,     motorNW,       tmotorNormal, openLoop)
-#pragma config(Motor,  mtr_S1_C1_2,     motorSW,       tmotorNormal, openLoop)
+#pragma config(Sensor, S3,     sensorSonar,         sensorSONAR)
+#pragma config(Motor,  mtr_S1_C1_1,     motorNW,       tmotorNormal, openLoop, encoder)
+#pragma config(Motor,  mtr_S1_C1_2,     motorSW,       tmotorNormal, openLoop, encoder)
 #pragma config(Motor,  mtr_S1_C2_1,     motorArm,      tmotorNormal, openLoop, encoder)
 #pragma config(Motor,  mtr_S1_C2_2,     motorG,        tmotorNormal, openLoop)
-#pragma config(Motor,  mtr_S1_C3_1,     motorNE,       tmotorNormal, openLoop)
-#pragma config(Motor,  mtr_S1_C3_2,     motorSE,       tmotorNormal, openLoop)
+#pragma config(Motor,  mtr_S1_C3_1,     motorNE,       tmotorNormal, openLoop, encoder)
+#pragma config(Motor,  mtr_S1_C3_2,     motorSE,       tmotorNormal, openLoop, encoder)
 #pragma config(Servo,  srvo_S1_C4_1,    servoCompass,         tServoStandard)
 #pragma config(Servo,  srvo_S1_C4_2,    servoScoop,           tServoStandard)
 #pragma config(Servo,  srvo_S1_C4_3,    servoSweeper,         tServoContinuousRotation)
@@ -24,17 +25,44 @@ bool kInFailureMode = false;
 
 #include "JoystickDriver.c"
 #include "4560_Common.h"
+#include "4560_Watchdog.h"
+#include "4560_Joystick.h"
+#include "4560_Driver.h"
+#include "4560_Pose.h"
+#include "4560_Range.h"
+#include "4560_Collision.h"
+#include "4560_Energy.h"
+#include "4560_ArmPosition.h"
 
-// The latest reading from the left joystick on controller 1
-float x_val, y_val;
+// How long TeleOp lasts (ms).
+#define kTeleOpTime 120000
+
+// Watchdog IDs of the tasks watched by watchdogTask.
+#define kTaskDriving 0
+#define kTaskArm 1
 
 void enterFailureMode()
 {
-  spin(0); // Easy way to setting all motors to 0.
-  stopSweeper();
+  // Set the flag and stop the motors in one go, so no other task can sneak in
+  // a motor write in between (they all check the flag first).
+  hogCPU();
+  kInFailureMode = true;
+  motor[motorNE] = 0;
+  motor[motorNW] = 0;
+  motor[motorSW] = 0;
+  motor[motorSE] = 0;
+  motor[motorArm] = 0;
+  for (int i = 0; i < kEncoderCount; i++)
+    nThermalPower[i] = 0;
+  releaseCPU();
+
+  armCancel();
+  sweeperOff();
+  faultDetected(kFaultMessageStall);
 
   // This will angle the compass arm at an angle to signify connection loss.
-  servo[servoCompass] = 128;
+  servoSet(kServoCompass, 128);
+  servoFlush();
 }
 
 void exitFailureMode()
@@ -48,33 +76,39 @@ task checkConnectivity()
   long lastMessageCount = 0;
 
   while(true) {
-    if (ntotalMessageCount == lastMessageCount) {
+    long messageCount = joystickMessageCount;
+    if (faultActive(kFaultMessageStall))
+      messageCount = lastMessageCount;
+
+    if (messageCount == lastMessageCount) {
       // Increase this number if the robot seems to "jitter", or thinks it
       // loses connection all the time. Decrease it if it takes too long to
       // detect a lost connection.
-      if (++missedMessageCount > 500) {
+      if (++missedMessageCount > 500 && !kInFailureMode)
         enterFailureMode();
-        kInFailureMode = true;
-      }
     }
     else { // The total message count changed, we have a connection!
-      if (kInFailureMode)
+      if (kInFailureMode) {
         exitFailureMode();
+        faultRecovered(kFaultMessageStall);
+      }
 
       kInFailureMode = false;
       missedMessageCount = 0;
     }
 
-    lastMessageCount = ntotalMessageCount;
+    lastMessageCount = messageCount;
   }
 }
 
 /**
  * Get the angle part of the left joystick and return it.
  *
+ * @param x_val The scaled x value of the left joystick.
+ * @param y_val The scaled y value of the left joystick.
  * @return Angle part of the left joystick (converted to a polar coordinate).
  */
-int getAngle()
+int getAngle(float x_val, float y_val)
 {
   return radiansToDegrees(atan2(x_val, y_val));
 }
@@ -87,8 +121,26 @@ int getAngle()
  */
 void initializeRobot()
 {
+  // Brake instead of coasting when a motor is set to 0, where the motor
+  // controller supports it.
+  bFloatDuringInactiveMotorPWM = false;
+
+  servoInit();
   compassSetup();
-  servo[servoScoop] = 150;
+  calibrationLoad();
+
+  // The arm starts out in the same place every time, and the presets are
+  // relative to that. If the program was restarted, the drivers can say the
+  // arm is where it was last saved instead.
+  nMotorEncoder[motorArm] = 0;
+  armPositionRestore();
+  encoderServiceStart();
+  thermalServiceStart();
+  armPositionServiceStart();
+  armControllerInit();
+
+  servoSet(kServoScoop, 150);
+  servoServiceStart();
 }
 
 /**
@@ -97,79 +149,391 @@ void initializeRobot()
 void aboutToStart()
 {
   compassUp();
+  servoSet(kServoScoop, scoopServoUp);
+  poseEstimatorStart(0, 0);
+  rangeServiceStart();
+  collisionDetectorStart();
+  energyServiceStart(kTeleOpTime);
 }
 
+// Hold this button on controller 1 to line up with the nearest field heading.
+#define kAlignButton 5
+
+// Hold this button on controller 1 to drive to kWallStandoff cm from the wall
+// in front (like the goal wall).
+#define kWallButton 6
+#define kWallStandoff 15
+
+// The field headings the robot can line up with, and how many there are.
+int nAlignHeadings[8] = {0, 45, 90, 135, 180, 225, 270, 315};
+int nAlignHeadingCount = 8;
+
 /**
- * The task handling the driving. This will get the joystick settings, and move
- * accordingly.
+ * Find the field heading (see nAlignHeadings) closest to a given heading.
+ *
+ * @param heading The heading to start from.
+ * @return The closest heading in nAlignHeadings.
+ */
+int nearestAlignHeading(int heading)
+{
+  int best = nAlignHeadings[0];
+
+  for (int i = 1; i < nAlignHeadingCount; i++)
+  {
+    if (abs(headingError(nAlignHeadings[i], heading)) <
+        abs(headingError(best, heading)))
+      best = nAlignHeadings[i];
+  }
+
+  return best;
+}
+
+// Each task's own copy of the joystick.
+TJoySnapshot driverJoystick;
+TJoySnapshot operatorJoystick;
+
+/**
+ * The task handling the driving. This will take a snapshot of the joystick
+ * every time a new message comes in, and move accordingly.
  *
  * The driving is all handled by the first game controller. The left joystick
  * drives the robot in the direction it's tilted. The right joystick spins the
  * robot in the direction it's tilted (clockwise is to the right, counter-
- * clockwise to the left).
+ * clockwise to the left). Holding button 5 spins the robot to the nearest
+ * field heading and keeps it there, while the left joystick still drives.
+ * Holding button 6 drives the robot to kWallStandoff cm from the wall in front
+ * and keeps it there, while the left joystick still drives sideways. They can
+ * be held together to line up square with the goal.
  */
 task drivingTask()
 {
+  bool bAligning = false;
+  bool bWallHolding = false;
+  int alignHeading = 0;
+
+  joystickInit(driverJoystick);
+
   while (true)
   {
-    getJoystickSettings(joystick);
+    heartbeat(kTaskDriving);
 
-    x_val = scaleJoystick(joystick.joy1_x1);
-    y_val = scaleJoystick(joystick.joy1_y1);
+    // Nothing changes until the next message, unless we're holding a heading
+    // or a distance from the wall.
+    if (!joystickUpdate(driverJoystick) && !bAligning && !bWallHolding)
+    {
+      abortTimeslice();
+      continue;
+    }
+
+    float x_val = scaleJoystick(driverJoystick.joy1_x1);
+    float y_val = scaleJoystick(driverJoystick.joy1_y1);
 
     // Magnitude part of a vector
     int speedMagnitude = (int)sqrt(pow(abs(x_val), 2) + pow(abs(y_val), 2));
 
     // Angle part of a vector
-    int speedDirection = getAngle();
+    int speedDirection = getAngle(x_val, y_val);
+
+    bool bMoving = x_val > 20 || x_val < -20 || y_val > 20 || y_val < -20;
+
+    bool bAlign = btnIn(driverJoystick.buttons1, kAlignButton);
+    bool bWall = btnIn(driverJoystick.buttons1, kWallButton);
 
-    if (x_val > 20 || x_val < -20 || y_val > 20 || y_val < -20)
+    if (bAlign || bWall)
+    {
+      int x = bMoving ? x_val : 0;
+      int y = bMoving ? y_val : 0;
+      int turn = 0;
+
+      if (bAlign)
+      {
+        // Pick the heading once when the button goes down, not every time.
+        if (!bAligning)
+        {
+          bAligning = true;
+          alignHeading = nearestAlignHeading(getHeading());
+          headingControllerReset();
+        }
+        turn = headingControllerStep(alignHeading);
+      }
+      else
+      {
+        bAligning = false;
+        if (driverJoystick.joy1_x2 > 10 || driverJoystick.joy1_x2 < -10)
+          turn = scaleJoystick(driverJoystick.joy1_x2);
+      }
+
+      if (bWall)
+      {
+        if (!bWallHolding)
+        {
+          bWallHolding = true;
+          wallHoldReset();
+        }
+        y = wallHoldStep(kWallStandoff);
+      }
+      else
+        bWallHolding = false;
+
+      drive(x, y, turn);
+      continue;
+    }
+    bAligning = false;
+    bWallHolding = false;
+
+    if (bMoving)
       // We want to move
       moveRobot(cap100(speedMagnitude), speedDirection);
-    else if (joystick.joy1_x2 > 10 || joystick.joy1_x2 < -10)
+    else if (driverJoystick.joy1_x2 > 10 || driverJoystick.joy1_x2 < -10)
       // We want to spin
-      spin(scaleJoystick(joystick.joy1_x2));
+      spin(scaleJoystick(driverJoystick.joy1_x2));
     else
       spin(0);
   }
 }
 
+// State changed by the arm actions: which way the arm is being driven by hand
+// (1 up, -1 down, 0 not at all), and whether the fast and teach buttons are
+// held.
+int nArmManual = 0;
+bool bArmFast = false;
+bool bTeaching = false;
+
+// Whether the arm is being driven with controller 2's left joystick.
+bool bArmStick = false;
+
+/**
+ * Drive the arm by hand according to nArmManual and bArmFast.
+ */
+void armManual()
+{
+  if (nArmManual != 0)
+  {
+    armCancel();
+    setArmMotor(nArmManual * (bArmFast ? 100 : 40));
+  }
+}
+
+/**
+ * Stop driving the arm by hand.
+ */
+void armManualStop()
+{
+  if (nArmManual != 0)
+  {
+    nArmManual = 0;
+    armStop();
+  }
+}
+
 /**
- * The task handling the arm. This will get the joystick settings, and move the
- * arm accordingly.
+ * Move to or teach an arm preset, depending on whether the teach button is
+ * held.
  *
- * The arm is all handled by the second game controller. The D-pad moves the
- * arm up and down, as well as button 6 and 8 (the buttons moves in steps, the
- * D-pad). This task (and possibly the whole program) hangs if you try moving
- * the arm too far with steps, as it never reaches where it wants to). Buttons
- * 2, 3 and 4 starts, stops and reverses the sweeper, respectively.
+ * @param slot The preset (0 to kArmPresetCount - 1).
+ */
+void armPreset(int slot)
+{
+  if (bTeaching)
+    armPresetTeach(slot);
+  else
+    armPresetGo(slot);
+}
+
+/**
+ * Do one of the actions from the input map.
+ *
+ * @param action The action (see 4560_Input.h).
+ */
+void doAction(int action)
+{
+  switch (action)
+  {
+    case kActionSweeperOn:      sweeperOn(); break;
+    case kActionSweeperOff:     sweeperOff(); break;
+    case kActionSweeperReverse: sweeperReverse(); break;
+    case kActionArmStepUp:      armStepUp(); break;
+    case kActionArmStepDown:    armStepDown(); break;
+    case kActionScoopUp:
+      servoSet(kServoScoop, servoGet(kServoScoop) + 5);
+      break;
+    case kActionScoopDown:
+      servoSet(kServoScoop, servoGet(kServoScoop) - 5);
+      break;
+    case kActionArmUp:      nArmManual = 1; armManual(); break;
+    case kActionArmDown:    nArmManual = -1; armManual(); break;
+    case kActionArmIdle:    armManualStop(); break;
+    case kActionArmFastOn:  bArmFast = true; armManual(); break;
+    case kActionArmFastOff: bArmFast = false; armManual(); break;
+    case kActionTeachOn:    bTeaching = true; break;
+    case kActionTeachOff:   bTeaching = false; break;
+    case kActionPreset1:    armPreset(0); break;
+    case kActionPreset2:    armPreset(1); break;
+    case kActionPreset3:    armPreset(2); break;
+  }
+}
+
+/**
+ * Do the actions for one controller's inputs. Only the inputs that changed
+ * since the last message, and the held inputs with hold actions, are looked
+ * at.
+ *
+ * @param controller The controller (0 for controller 1, 1 for controller 2).
+ * @param inputs The controller's input mask now (see inputMask()).
+ * @param lastInputs The controller's input mask with the last message.
+ */
+void dispatchInputs(int controller, long inputs, long lastInputs)
+{
+  long changed = inputs ^ lastInputs;
+  long held = inputs & nInputHoldMask[controller];
+  int input = 0;
+
+  while (changed != 0 || held != 0)
+  {
+    if (changed & 1)
+    {
+      int event = (inputs & (1L << input)) ? kEventPress : kEventRelease;
+      doAction(nInputAction[controller][input * kEventCount + event]);
+    }
+    if (held & 1)
+      doAction(nInputAction[controller][input * kEventCount + kEventHold]);
+
+    changed = (changed >> 1) & 0x7FFFFFFF;
+    held = (held >> 1) & 0x7FFFFFFF;
+    input++;
+  }
+}
+
+// A scoring cycle is counted each time the scoop is tipped (below
+// kCycleScoopTipped) with the arm up (above kCycleArmUp), as long as the arm
+// has been back down (below kCycleArmDown) since the last one.
+#define kCycleArmUp kArmLevelPosition
+#define kCycleArmDown (kArmLevelPosition / 3)
+#define kCycleScoopTipped 90
+
+long nScoringCycles = 0;
+bool bCycleArmDown = true;
+
+/**
+ * Count scoring cycles. Call this from the arm loop.
+ */
+void cycleCount()
+{
+  long position = encoderPosition(kEncArm);
+
+  if (position < kCycleArmDown)
+    bCycleArmDown = true;
+  else if (bCycleArmDown && position > kCycleArmUp &&
+           servoGet(kServoScoop) < kCycleScoopTipped)
+  {
+    bCycleArmDown = false;
+    nScoringCycles++;
+  }
+}
+
+/**
+ * The task handling the arm. This will take a snapshot of the joystick every
+ * time a new message comes in, and do the actions the input map (see
+ * 4560_Input.h) has for the inputs that changed.
+ *
+ * With the default map, the arm is all handled by the second game controller.
+ * The D-pad moves the arm up and down (faster with button 1 held), as well as
+ * button 6 and 8 (the buttons moves in steps, the D-pad). This task hangs if
+ * you try moving the arm too far with steps, as it never reaches where it
+ * wants to, but watchdogTask will notice and restart it). Buttons 2, 3 and 4
+ * starts, stops and reverses the sweeper, respectively, and buttons 9 and 10
+ * tilt the scoop. The left joystick moves the arm at a speed that depends on
+ * how far it's pushed, for both fine placement and fast moves.
+ *
+ * Buttons 7, 11 and 12 move the arm and the scoop to a preset position in one
+ * go. Holding button 5 while pressing one of them saves where the arm and the
+ * scoop are right now in that preset instead.
  */
 task armTask()
 {
-  servo[servoScoop] = scoopServoUp;
+  long lastInputs1 = 0;
+  long lastInputs2 = 0;
+
+  joystickInit(operatorJoystick);
+
+  while (true)
+  {
+    heartbeat(kTaskArm);
+
+    if (joystickUpdate(operatorJoystick))
+    {
+      long inputs1 = inputMask(operatorJoystick.buttons1,
+                               operatorJoystick.joy1_TopHat);
+      long inputs2 = inputMask(operatorJoystick.buttons2,
+                               operatorJoystick.joy2_TopHat);
+
+      dispatchInputs(0, inputs1, lastInputs1);
+      dispatchInputs(1, inputs2, lastInputs2);
+
+      lastInputs1 = inputs1;
+      lastInputs2 = inputs2;
+    }
+
+    // The arm controller needs updating all the time, not just when a new
+    // message comes in. The D-pad wins over the joystick, and the joystick
+    // wins over presets.
+    int armVelocity = armStickVelocity(operatorJoystick.joy2_y1);
+    if (nArmManual != 0)
+      bArmStick = false;
+    else if (armVelocity != 0)
+    {
+      bArmStick = true;
+      armVelocityStep(armVelocity);
+    }
+    else
+    {
+      if (bArmStick)
+      {
+        // Let go of the arm, just like when the D-pad is let go.
+        bArmStick = false;
+        armStop();
+      }
+      armControlStep();
+      armBrakeStep();
+
+      // Nothing else is driving the arm, so make sure it's not left running.
+      if (!bArmMoving && !bArmBraking && motor[motorArm] != 0)
+        setArmMotor(0);
+    }
+
+    cycleCount();
+    abortTimeslice();
+  }
+}
+
+/**
+ * The task keeping an eye on the other tasks. If one of them stops sending
+ * heartbeats, its motors are stopped and it's restarted from the top.
+ */
+task watchdogTask()
+{
   while (true)
   {
-    getJoystickSettings(joystick);
-    if (joy2Btn(2))
-      sweeperOn();
-    if (joy2Btn(4))
-      sweeperReverse();
-    if (joy2Btn(3))
-      sweeperOff();
-    if (joy2Btn(6))
-      armStepUp();
-    if (joy2Btn(8))
-      armStepDown();
-    if (joy2Btn(9))
-      servo[servoScoop] = ServoValue[servoScoop] + 5;
-    if (joy2Btn(10))
-      servo[servoScoop] = ServoValue[servoScoop] - 5;
-    if (joystick.joy2_TopHat == TopHat_Up)
-      motor[motorArm] = (joy2Btn(1) ? 100 : 40);
-    if (joystick.joy2_TopHat == TopHat_Down)
-      motor[motorArm] = (joy2Btn(1) ? -100 : -40);
-    if (joystick.joy2_TopHat == TopHat_Idle)
+    wait1Msec(kWatchdogPeriod);
+
+    int id = watchdogFindStale();
+
+    if (id == kTaskDriving)
+    {
+      StopTask(drivingTask);
+      spin(0);
+      watchdogRestarted(id);
+      StartTask(drivingTask);
+    }
+    else if (id == kTaskArm)
+    {
+      StopTask(armTask);
+      armCancel();
       motor[motorArm] = 0;
+      nThermalPower[kEncArm] = 0;
+      watchdogRestarted(id);
+      StartTask(armTask);
+    }
   }
 }
 
@@ -181,14 +545,47 @@ task armTask()
 task main()
 {
   initializeRobot();
+#ifdef SCRIPTED_DRIVER
+  // There's no FCS to start us, so just go.
+  scriptedDriverStart();
+#else
   waitForStart();
+#endif
   aboutToStart();
+  faultInjectionStart();
   StartTask(checkConnectivity);
+  watchdogWatch(kTaskDriving);
   StartTask(drivingTask);
+  watchdogWatch(kTaskArm);
   StartTask(armTask);
+  StartTask(watchdogTask, kHighPriority);
+
+  bool bLowBattery = false;
+  bool bCyclesReported = false;
+  long matchStart = nSysTime;
 
   // So the program doesn't just exit.
   while (true) {
+    // Log it once when the battery gets low (it's -1 if there's no battery).
+    int batteryLevel = getBatteryLevel();
+    if (batteryLevel >= 0 && batteryLevel < kLowBatteryLevel) {
+      if (!bLowBattery) {
+        telemetryEvent(kEventLowBattery, batteryLevel, 0);
+        faultDetected(kFaultBrownout);
+      }
+      bLowBattery = true;
+    }
+    else if (bLowBattery) {
+      bLowBattery = false;
+      faultRecovered(kFaultBrownout);
+    }
+
+    // Log how many scoring cycles we got through in the match.
+    if (!bCyclesReported && nSysTime - matchStart >= kTeleOpTime) {
+      telemetryEvent(kEventCycles, nScoringCycles, kTeleOpTime / 1000);
+      bCyclesReported = true;
+    }
+
     // We don't want to hog the CPU here...
     wait1Msec(5);
   }
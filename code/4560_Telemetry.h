@@ -0,0 +1,61 @@
+/**
+ * Telemetry for team 4560's robot. Things worth knowing about after a match
+ * (task restarts and so on) are logged here as events. The last few are kept
+ * in memory, and all of them are written to the debug stream.
+ * All code written by Henrik Hodne unless otherwise noted. All code by Henrik
+ * Hodne is released under the MIT license (see the LICENSE file).
+ */
+
+
+#ifndef __4560_TELEMETRY_H__
+#define __4560_TELEMETRY_H__
+
+// How many events to keep in memory. Must be a power of two.
+#define kTelemetrySize 16
+
+// Event types. What the two values of an event mean depends on its type.
+#define kEventTaskRestart 1     // Task ID, ms since its last heartbeat
+#define kEventFaultInjected 2   // Fault type, 0
+#define kEventFaultDetected 3   // Fault type, ms since it was injected
+#define kEventFaultRecovered 4  // Fault type, ms since it went away
+#define kEventLowBattery 5      // Battery level (mV), 0
+#define kEventArmStall 6        // Arm position, where it should be
+#define kEventArmBrake 7        // Ticks drifted after let go, ms to stop
+#define kEventDriveDone 8       // Ticks short of the end, ms it took
+#define kEventPoseOverBudget 9  // Average µs per pose step, the budget
+#define kEventCollision 10      // 1 if blocked, how far off the turn was
+#define kEventTurnDone 11       // Degrees turned, ms it took
+#define kEventTurnModel 12      // Acceleration, deceleration (degrees/s/s)
+#define kEventThermalDerate 13  // Motor (kEncNW and so on), headroom (%)
+#define kEventEnergy 14         // Drive energy, arm energy (J) in a match
+#define kEventCycles 15         // Scoring cycles in a match, match length (s)
+
+int nEventType[kTelemetrySize];
+long nEventTime[kTelemetrySize];
+int nEventValueA[kTelemetrySize];
+int nEventValueB[kTelemetrySize];
+long nEventCount = 0;
+
+/**
+ * Log an event.
+ *
+ * @param type What happened (one of the kEvent constants).
+ * @param valueA The first value of the event.
+ * @param valueB The second value of the event.
+ */
+void telemetryEvent(int type, int valueA, int valueB)
+{
+  hogCPU();
+  int i = nEventCount & (kTelemetrySize - 1);
+  nEventType[i] = type;
+  nEventTime[i] = nSysTime;
+  nEventValueA[i] = valueA;
+  nEventValueB[i] = valueB;
+  nEventCount++;
+  releaseCPU();
+
+  writeDebugStreamLine("%d: event %d (%d, %d)", nEventTime[i], type, valueA,
+                       valueB);
+}
+
+#endif // __4560_TELEMETRY_H__
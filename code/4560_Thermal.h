@@ -0,0 +1,130 @@
+/**
+ * Motor heat model for team 4560's robot. The motor controllers shut a motor
+ * off when it has drawn too much current for too long (like the arm held up at
+ * full power, or the drive pushing against a wall). This keeps a rough
+ * estimate of how close each motor is to that, and turns its power down bit by
+ * bit before it gets there.
+ * All code written by Henrik Hodne unless otherwise noted. All code by Henrik
+ * Hodne is released under the MIT license (see the LICENSE file).
+ */
+
+
+#ifndef __4560_THERMAL_H__
+#define __4560_THERMAL_H__
+
+#include "4560_Control.h"
+#include "4560_Encoders.h"
+#include "4560_Telemetry.h"
+
+// How often (in ms) the model is updated.
+#define kThermalPeriod 100
+
+// The current a motor draws is taken to be what's left of its power after the
+// back EMF of it turning, which is kThermalBackEmf (Q8) per tick/s. At full
+// power, with nothing holding it back, it's about 2500 ticks/s.
+#define kThermalBackEmf 10
+
+// The heat goes up by the current squared each update, and a 1/2^kThermalShift
+// of it goes away, so it follows the current over about 2^kThermalShift
+// updates (12.8 s).
+#define kThermalShift 7
+
+// The controller trips when a motor keeps drawing kThermalTripCurrent (in
+// percent of stall current). Motors are turned down from kThermalDerateStart
+// percent of that heat, to kThermalMinLimit percent of their power at it.
+#define kThermalTripCurrent 70
+#define kThermalTripHeat \
+  ((long)kThermalTripCurrent * kThermalTripCurrent << kThermalShift)
+#define kThermalDerateStart 80
+#define kThermalMinLimit 25
+
+// How often (in ms) the headroom is written to the debug stream.
+#define kThermalReportPeriod 10000
+
+// The power each motor was last given, its heat, how much of its power it's
+// allowed (percent), and how much heat it can still take before the controller
+// trips (percent). All are indexed like the encoders (kEncNW and so on).
+int nThermalPower[kEncoderCount];
+long nThermalHeat[kEncoderCount];
+int nThermalLimit[kEncoderCount] = {100, 100, 100, 100, 100};
+int nThermalHeadroom[kEncoderCount] = {100, 100, 100, 100, 100};
+
+/**
+ * Update the heat of every motor, and how much power they're allowed.
+ */
+void thermalTick()
+{
+  for (int i = 0; i < kEncoderCount; i++)
+  {
+    long current = nThermalPower[i] -
+                   (((long)encoderVelocity(i) * kThermalBackEmf) >> 8);
+    current = clampLong(current, -100, 100);
+
+    long heat = nThermalHeat[i];
+    heat += current * current - (heat >> kThermalShift);
+    nThermalHeat[i] = heat;
+
+    int headroom = 100 - heat * 100 / kThermalTripHeat;
+    int limit = 100;
+    if (headroom <= 0)
+      limit = kThermalMinLimit;
+    else if (headroom < 100 - kThermalDerateStart)
+      limit = kThermalMinLimit + (100 - kThermalMinLimit) * headroom /
+                                 (100 - kThermalDerateStart);
+
+    if (limit < 100 && nThermalLimit[i] == 100)
+      telemetryEvent(kEventThermalDerate, i, headroom);
+
+    nThermalHeadroom[i] = max(headroom, 0);
+    nThermalLimit[i] = limit;
+  }
+}
+
+/**
+ * Keep the heat model up to date.
+ */
+task thermalService()
+{
+  long lastReport = nSysTime;
+
+  while (true)
+  {
+    thermalTick();
+
+    if (nSysTime - lastReport >= kThermalReportPeriod)
+    {
+      writeDebugStreamLine("headroom: %d %d %d %d %d", nThermalHeadroom[0],
+                           nThermalHeadroom[1], nThermalHeadroom[2],
+                           nThermalHeadroom[3], nThermalHeadroom[4]);
+      lastReport = nSysTime;
+    }
+
+    wait1Msec(kThermalPeriod);
+  }
+}
+
+/**
+ * Start the heat model. The encoder service has to be running.
+ */
+void thermalServiceStart()
+{
+  StartTask(thermalService);
+}
+
+/**
+ * Turn a motor's power down as far as its heat says. Call this with every
+ * power about to be given to a motor, and put what's actually given in
+ * nThermalPower.
+ *
+ * @param motorIndex The motor (kEncNW and so on).
+ * @param power The power it should get.
+ * @return The power it's allowed.
+ */
+int thermalLimit(int motorIndex, int power)
+{
+  if (nThermalLimit[motorIndex] < 100)
+    return (long)power * nThermalLimit[motorIndex] / 100;
+  return power;
+}
+
+#endif // __4560_THERMAL_H__
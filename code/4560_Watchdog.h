@@ -0,0 +1,95 @@
+/**
+ * Task watchdog for team 4560's robot. Every watched task calls heartbeat()
+ * each time around its loop, and a supervisor task calls watchdogFindStale()
+ * to find the ones that stopped doing that. Restarting a task has to happen in
+ * the program that owns it, since StartTask() needs the task's name.
+ * All code written by Henrik Hodne unless otherwise noted. All code by Henrik
+ * Hodne is released under the MIT license (see the LICENSE file).
+ */
+
+
+#ifndef __4560_WATCHDOG_H__
+#define __4560_WATCHDOG_H__
+
+#include "4560_Telemetry.h"
+
+// How often (in ms) the supervisor should check, and how long (in ms) a task
+// can go without a heartbeat before it counts as hung. A hung task is found
+// at most kWatchdogTimeout + kWatchdogPeriod ms after its last heartbeat.
+#define kWatchdogPeriod 50
+#define kWatchdogTimeout 500
+
+#define kWatchdogMaxTasks 4
+
+bool bWatchdogWatching[kWatchdogMaxTasks];
+long nHeartbeatTime[kWatchdogMaxTasks];
+int nWatchdogRestarts[kWatchdogMaxTasks];
+
+// How long (in ms) after its last heartbeat each task was last found hung.
+long nWatchdogLatency[kWatchdogMaxTasks];
+
+/**
+ * Tell the watchdog that a task is alive. Call this once every time around
+ * the task's loop.
+ *
+ * @param id The task's watchdog ID.
+ */
+void heartbeat(int id)
+{
+  nHeartbeatTime[id] = nSysTime;
+}
+
+/**
+ * Start watching a task. Call this right before starting it.
+ *
+ * @param id The task's watchdog ID (0 to kWatchdogMaxTasks - 1).
+ */
+void watchdogWatch(int id)
+{
+  heartbeat(id);
+  bWatchdogWatching[id] = true;
+}
+
+/**
+ * Stop watching a task.
+ *
+ * @param id The task's watchdog ID.
+ */
+void watchdogIgnore(int id)
+{
+  bWatchdogWatching[id] = false;
+}
+
+/**
+ * Find a watched task that's gone too long without a heartbeat.
+ *
+ * @return The watchdog ID of the hung task, or -1 if they're all fine.
+ */
+int watchdogFindStale()
+{
+  long now = nSysTime;
+
+  for (int id = 0; id < kWatchdogMaxTasks; id++)
+  {
+    if (bWatchdogWatching[id] && now - nHeartbeatTime[id] > kWatchdogTimeout)
+      return id;
+  }
+
+  return -1;
+}
+
+/**
+ * Record that a hung task has been restarted, and give it a fresh heartbeat.
+ *
+ * @param id The task's watchdog ID.
+ */
+void watchdogRestarted(int id)
+{
+  nWatchdogLatency[id] = nSysTime - nHeartbeatTime[id];
+  nWatchdogRestarts[id]++;
+  heartbeat(id);
+
+  telemetryEvent(kEventTaskRestart, id, nWatchdogLatency[id]);
+}
+
+#endif // __4560_WATCHDOG_H__